@@ -12,6 +12,8 @@
 #include "lib/sionna-propagation-cache.h"
 #include "lib/sionna-propagation-delay-model.h"
 #include "lib/sionna-propagation-loss-model.h"
+#include "lib/sionna-wifi-channel.h"
+#include "lib/sionna-wifi-phy.h"
 
 // Ns-3 modules
 #include "ns3/applications-module.h"
@@ -49,6 +51,7 @@ main(int argc, char* argv[])
     std::string environment = "munich/munich.xml";
     int wifi_channel_num = 6;
     int channel_width = 20; // 802.11g supports only 20MHz
+    bool sionna_channel = false;
 
     CommandLine cmd(__FILE__);
     cmd.AddValue("verbose", "Enable logging", verbose);
@@ -57,6 +60,7 @@ main(int argc, char* argv[])
     cmd.AddValue("environment", "Xml file of environment", environment);
     cmd.AddValue("channel", "The WiFi channel number", wifi_channel_num);
     cmd.AddValue("channelWidth", "The WiFi channel width in MHz", channel_width);
+    cmd.AddValue("sionnaChannel", "Deliver frames only to the receivers that can hear them", sionna_channel);
     cmd.Parse(argc, argv);
 
     if (verbose)
@@ -81,23 +85,35 @@ main(int argc, char* argv[])
     wifiApNode.Create(1);
 
     // Create a channel
-    Ptr<YansWifiChannel> channel = CreateObject<YansWifiChannel>();
-
     Ptr<SionnaPropagationCache> propagationCache = CreateObject<SionnaPropagationCache>();
     propagationCache->SetSionnaHelper(sionnaHelper);
     propagationCache->SetCaching(caching);
 
-    Ptr<SionnaPropagationDelayModel> delayModel = CreateObject<SionnaPropagationDelayModel>();
-    delayModel->SetPropagationCache(propagationCache);
+    Ptr<YansWifiChannel> channel;
+    Ptr<SionnaWifiChannel> sionnaChannel;
+    if (sionna_channel)
+    {
+        // the channel creates the Sionna loss and delay models itself
+        sionnaChannel = CreateObject<SionnaWifiChannel>();
+        sionnaChannel->SetPropagationCache(propagationCache);
+        channel = sionnaChannel;
+    }
+    else
+    {
+        channel = CreateObject<YansWifiChannel>();
+
+        Ptr<SionnaPropagationDelayModel> delayModel = CreateObject<SionnaPropagationDelayModel>();
+        delayModel->SetPropagationCache(propagationCache);
 
-    Ptr<SionnaPropagationLossModel> lossModel = CreateObject<SionnaPropagationLossModel>();
-    lossModel->SetPropagationCache(propagationCache);
+        Ptr<SionnaPropagationLossModel> lossModel = CreateObject<SionnaPropagationLossModel>();
+        lossModel->SetPropagationCache(propagationCache);
 
-    channel->SetPropagationLossModel(lossModel);
-    channel->SetPropagationDelayModel(delayModel);
+        channel->SetPropagationLossModel(lossModel);
+        channel->SetPropagationDelayModel(delayModel);
+    }
 
     // WiFi configuration
-    YansWifiPhyHelper phy;
+    YansWifiPhyHelper phy = sionna_channel ? SionnaWifiPhyHelper() : YansWifiPhyHelper();
     phy.SetChannel(channel);
 
     WifiMacHelper mac;
@@ -213,6 +229,10 @@ main(int argc, char* argv[])
     sionnaHelper.Start();
 
     Simulator::Run();
+    if (sionnaChannel)
+    {
+        sionnaChannel->PrintStats(std::cout);
+    }
     Simulator::Destroy();
 
     sionnaHelper.Destroy();
@@ -12,6 +12,8 @@
 #include "lib/sionna-propagation-cache.h"
 #include "lib/sionna-propagation-delay-model.h"
 #include "lib/sionna-propagation-loss-model.h"
+#include "lib/sionna-image-method.h"
+#include "lib/sionna-scene-geometry.h"
 
 // Ns-3 modules
 #include "../../src/wifi/model/yans-wifi-phy.h"
@@ -53,6 +55,13 @@ main(int argc, char* argv[])
     int wifi_channel_num = 6;
     int channel_width = 20; // 802.11g supports only 20MHz
     double dist_ap_sta = 300.0;
+    double rt_margin = 0.0; // min. SNR margin (in dB) for ray tracing
+    double ld_margin = 0.0; // min. SNR margin (in dB) for log-distance; Friis below
+    double hysteresis = 0.0;
+    bool geometry = false; // walls between the nodes are considered when choosing the tier
+    double mw_margin = 0.0; // min. SNR margin (in dB) for multi-wall
+    bool image_method = false; // static links are computed locally from the scene meshes
+    uint32_t im_validation = 0; // every n-th link of the image method is compared against Sionna
 
     CommandLine cmd(__FILE__);
     cmd.AddValue("verbose", "Enable logging", verbose);
@@ -62,6 +71,13 @@ main(int argc, char* argv[])
     cmd.AddValue("environment", "Xml file of environment", environment);
     cmd.AddValue("channel", "The WiFi channel number", wifi_channel_num);
     cmd.AddValue("distApSta", "The WiFi channel number", dist_ap_sta);
+    cmd.AddValue("rtMargin", "Min. estimated SNR margin (dB) of links computed with ray tracing", rt_margin);
+    cmd.AddValue("ldMargin", "Min. estimated SNR margin (dB) of links computed with log-distance", ld_margin);
+    cmd.AddValue("hysteresis", "Hysteresis (dB) for changing the tier of a link", hysteresis);
+    cmd.AddValue("geometry", "Load the scene meshes to account for walls when choosing the tier", geometry);
+    cmd.AddValue("mwMargin", "Min. estimated SNR margin (dB) of links computed with multi-wall", mw_margin);
+    cmd.AddValue("imageMethod", "Compute links between static nodes with the native image method", image_method);
+    cmd.AddValue("imValidation", "Compare every n-th image method link against Sionna (0: never)", im_validation);
     cmd.Parse(argc, argv);
 
     if (verbose)
@@ -92,6 +108,22 @@ main(int argc, char* argv[])
     propagationCache->SetSionnaHelper(sionnaHelper);
     propagationCache->SetCaching(caching);
     propagationCache->SetOptimize(optimizer);
+    propagationCache->SetFidelityTiers(rt_margin, ld_margin, hysteresis);
+    if (geometry || image_method)
+    {
+        Ptr<SionnaSceneGeometry> sceneGeometry = CreateObject<SionnaSceneGeometry>();
+        sceneGeometry->Load("scratch/ns3-sionna/../models/" + environment);
+        if (geometry)
+        {
+            propagationCache->SetMultiWallTier(sceneGeometry, mw_margin);
+        }
+        if (image_method)
+        {
+            Ptr<SionnaImageMethodEngine> imageMethod = CreateObject<SionnaImageMethodEngine>();
+            imageMethod->SetSceneGeometry(sceneGeometry);
+            propagationCache->SetImageMethodEngine(imageMethod, im_validation);
+        }
+    }
 
     Ptr<SionnaPropagationDelayModel> delayModel = CreateObject<SionnaPropagationDelayModel>();
     delayModel->SetPropagationCache(propagationCache);
@@ -220,6 +252,8 @@ main(int argc, char* argv[])
     Simulator::Run();
     Simulator::Destroy();
 
+    propagationCache->PrintStats(std::cout);
+
     sionnaHelper.Destroy();
 
     return 0;
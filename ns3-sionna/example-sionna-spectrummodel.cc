@@ -7,11 +7,13 @@
  */
 
 // Sionna models
+#include "lib/sionna-error-rate-model.h"
 #include "lib/sionna-helper.h"
 #include "lib/sionna-mobility-model.h"
 #include "lib/sionna-propagation-cache.h"
 #include "lib/sionna-propagation-delay-model.h"
 #include "lib/sionna-propagation-loss-model.h"
+#include "lib/sionna-spectrum-propagation-loss-model.h"
 
 // Ns-3 modules
 #include "../../src/wifi/model/spectrum-wifi-phy.h"
@@ -50,6 +52,8 @@ main(int argc, char* argv[])
     std::string environment = "simple_room/simple_room.xml";
     int wifi_channel_num = 46;
     int channelWidth = 40;
+    bool frequencySelective = false;
+    bool eesm = false;
 
     CommandLine cmd(__FILE__);
     cmd.AddValue("verbose", "Enable logging", verbose);
@@ -58,6 +62,8 @@ main(int argc, char* argv[])
     cmd.AddValue("environment", "Xml file of environment", environment);
     cmd.AddValue("channel", "The WiFi channel number", wifi_channel_num);
     cmd.AddValue("channelWidth", "The WiFi channel width in MHz", channelWidth);
+    cmd.AddValue("frequencySelective", "Shape the PSD with the CSI from Sionna", frequencySelective);
+    cmd.AddValue("eesm", "Error rate model with effective SNR from the CSI (EESM)", eesm);
     cmd.Parse(argc, argv);
 
     if (verbose)
@@ -96,6 +102,16 @@ main(int argc, char* argv[])
 
     spectrumChannel->AddPropagationLossModel(lossModel);
 
+    if (frequencySelective)
+    {
+        // the wideband loss is applied by lossModel, only the shape of |H(f)|^2 here
+        Ptr<SionnaSpectrumPropagationLossModel> spectrumLossModel =
+            CreateObject<SionnaSpectrumPropagationLossModel>();
+        spectrumLossModel->SetAttribute("Normalize", BooleanValue(true));
+        spectrumLossModel->SetPropagationCache(propagationCache);
+        spectrumChannel->AddSpectrumPropagationLossModel(spectrumLossModel);
+    }
+
     Ptr<SionnaPropagationDelayModel> delayModel = CreateObject<SionnaPropagationDelayModel>();
     delayModel->SetPropagationCache(propagationCache);
     spectrumChannel->SetPropagationDelayModel(delayModel);
@@ -126,6 +142,20 @@ main(int argc, char* argv[])
     spectrumPhy.Set("ChannelSettings", StringValue(channelStr));
     apDevices = wifi.Install(spectrumPhy, mac, wifiApNode);
 
+    // replaces the NistErrorRateModel of each PHY
+    std::vector<Ptr<SionnaErrorRateModel>> errorRateModels;
+    if (eesm)
+    {
+        NetDeviceContainer devices(apDevices, staDevices);
+        for (auto it = devices.Begin(); it != devices.End(); ++it)
+        {
+            Ptr<SionnaErrorRateModel> errorRateModel = CreateObject<SionnaErrorRateModel>();
+            errorRateModel->SetPropagationCache(propagationCache);
+            errorRateModel->AttachToPhy(DynamicCast<WifiNetDevice>(*it)->GetPhy());
+            errorRateModels.push_back(errorRateModel);
+        }
+    }
+
     // Mobility configuration
     MobilityHelper mobility;
 
@@ -236,6 +266,10 @@ main(int argc, char* argv[])
     sionnaHelper.Start();
 
     Simulator::Run();
+    for (const Ptr<SionnaErrorRateModel>& errorRateModel : errorRateModels)
+    {
+        errorRateModel->PrintStats(std::cout);
+    }
     Simulator::Destroy();
 
     sionnaHelper.Destroy();
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#include "sionna-error-rate-model.h"
+
+#include "ns3/log.h"
+#include "ns3/net-device.h"
+#include "ns3/node-list.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("SionnaErrorRateModel");
+
+NS_OBJECT_ENSURE_REGISTERED(SionnaErrorRateModel);
+
+TypeId
+SionnaErrorRateModel::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::SionnaErrorRateModel")
+            .SetParent<ErrorRateModel>()
+            .SetGroupName("Wifi")
+            .AddConstructor<SionnaErrorRateModel>();
+    return tid;
+}
+
+SionnaErrorRateModel::SionnaErrorRateModel()
+    : m_propagationCache(nullptr),
+      m_band(0),
+      m_rx_node(nullptr),
+      m_tx_node(nullptr),
+      m_lookups(0),
+      m_computed(0)
+{
+    m_nistModel = CreateObject<NistErrorRateModel>();
+}
+
+SionnaErrorRateModel::~SionnaErrorRateModel()
+{
+}
+
+void
+SionnaErrorRateModel::SetPropagationCache(Ptr<SionnaPropagationCache> propagationCache)
+{
+    m_propagationCache = propagationCache;
+}
+
+void
+SionnaErrorRateModel::SetBand(uint32_t band)
+{
+    m_band = band;
+    m_links.clear();
+}
+
+void
+SionnaErrorRateModel::AttachToPhy(Ptr<WifiPhy> phy)
+{
+    m_rx_node = phy->GetDevice()->GetNode();
+    phy->SetErrorRateModel(this);
+    phy->TraceConnectWithoutContext("PhyRxMacHeaderEnd",
+                                    MakeCallback(&SionnaErrorRateModel::NotifyRxMacHeaderEnd, this));
+}
+
+void
+SionnaErrorRateModel::NotifyRxMacHeaderEnd(const WifiMacHeader& hdr, const WifiTxVector& /* txVector */,
+                                           Time /* psduDuration */)
+{
+    m_tx_node = nullptr;
+    // ACK and CTS carry no TA
+    if (hdr.IsAck() || hdr.IsCts())
+    {
+        return;
+    }
+    uint32_t tx_id;
+    if (m_propagationCache && m_propagationCache->GetNodeId(hdr.GetAddr2(), tx_id))
+    {
+        m_tx_node = NodeList::GetNode(tx_id);
+    }
+}
+
+double
+SionnaErrorRateModel::GetBeta(WifiMode mode)
+{
+    // calibrated values of the literature per modulation and coding rate (1/2, 2/3, 3/4, 5/6)
+    static const std::map<uint16_t, std::vector<double>> betas = {
+        {2, {1.0, 1.1, 1.2, 1.3}},
+        {4, {1.49, 1.6, 1.69, 1.8}},
+        {16, {3.36, 4.0, 4.56, 5.0}},
+        {64, {8.0, 9.21, 10.81, 13.76}},
+        {256, {20.0, 22.0, 23.5, 28.5}},
+        {1024, {70.0, 78.0, 85.0, 100.0}},
+        {4096, {250.0, 280.0, 310.0, 350.0}},
+    };
+
+    auto it = betas.find(mode.GetConstellationSize());
+    if (it == betas.end())
+    {
+        // e.g. DSSS: no frequency selectivity assumed
+        return 1.0;
+    }
+    WifiCodeRate rate = mode.GetCodeRate();
+    size_t index = rate == WIFI_CODE_RATE_2_3 ? 1 : rate == WIFI_CODE_RATE_3_4 ? 2 : rate == WIFI_CODE_RATE_5_6 ? 3 : 0;
+    return it->second[index];
+}
+
+double
+SionnaErrorRateModel::DoGetChunkSuccessRate(WifiMode mode,
+                                            const WifiTxVector& txVector,
+                                            double snr,
+                                            uint64_t nbits,
+                                            uint8_t numRxAntennas,
+                                            WifiPpduField field,
+                                            uint16_t staId) const
+{
+    if (field == WIFI_PPDU_FIELD_DATA)
+    {
+        snr = GetEffectiveSnr(mode, snr);
+    }
+    return m_nistModel->GetChunkSuccessRate(mode, txVector, snr, nbits, numRxAntennas, field, staId);
+}
+
+double
+SionnaErrorRateModel::GetEffectiveSnr(WifiMode mode, double snr) const
+{
+    if (!m_propagationCache || !m_rx_node || !m_tx_node || snr <= 0)
+    {
+        return snr;
+    }
+    m_lookups += 1;
+
+    Time start_time;
+    Time end_time;
+    const std::vector<std::complex<double>>& csi =
+        m_propagationCache->GetChannelState(m_tx_node->GetObject<MobilityModel>(),
+                                            m_rx_node->GetObject<MobilityModel>(), start_time, end_time,
+                                            m_band);
+    if (csi.empty())
+    {
+        return snr;
+    }
+
+    // the CSI shape is derived once per window of the link
+    LinkState& state = m_links[m_tx_node->GetId()];
+    if (state.m_gain.size() != csi.size() || state.m_start_time != start_time)
+    {
+        state.m_start_time = start_time;
+        state.m_gain.resize(csi.size());
+        state.m_ratio.clear();
+        double mean_power = 0;
+        for (size_t k = 0; k < csi.size(); k++)
+        {
+            state.m_gain[k] = std::norm(csi[k]);
+            mean_power += state.m_gain[k];
+        }
+        mean_power /= csi.size();
+        if (mean_power <= 0)
+        {
+            state.m_gain.assign(csi.size(), 1.0);
+            mean_power = 1.0;
+        }
+        state.m_min_gain = std::numeric_limits<double>::max();
+        for (size_t k = 0; k < csi.size(); k++)
+        {
+            state.m_gain[k] /= mean_power;
+            state.m_min_gain = std::min(state.m_min_gain, state.m_gain[k]);
+        }
+    }
+
+    // memoized per mode and wideband SNR (in steps of 0.1 dB)
+    auto key = std::make_pair(mode.GetUid(), static_cast<int64_t>(std::llround(100 * std::log10(snr))));
+    auto it = state.m_ratio.find(key);
+    if (it != state.m_ratio.end())
+    {
+        return it->second * snr;
+    }
+    m_computed += 1;
+
+    // EESM: snr_eff = -beta * ln(mean_k exp(-snr_k / beta)); relative to the min. subcarrier SNR, so that each
+    // term is in (0, 1] and the sum does not underflow at high SNR; branch-free, so that it can be vectorized
+    double beta = GetBeta(mode);
+    double scale = snr / beta;
+    double min_gain = state.m_min_gain;
+    const double* gain = state.m_gain.data();
+    size_t n = state.m_gain.size();
+    double sum = 0;
+    for (size_t k = 0; k < n; k++)
+    {
+        sum += std::exp(-scale * (gain[k] - min_gain));
+    }
+    double eff_snr = snr * min_gain - beta * std::log(sum / n);
+
+    double ratio = eff_snr / snr;
+    NS_LOG_DEBUG("EESM " << m_tx_node->GetId() << " -> " << m_rx_node->GetId() << " " << mode << ": "
+                 << 10 * std::log10(snr) << " dB -> " << 10 * std::log10(eff_snr) << " dB");
+    state.m_ratio[key] = ratio;
+    return eff_snr;
+}
+
+void
+SionnaErrorRateModel::PrintStats(std::ostream& os) const
+{
+    os << "EESM (node " << (m_rx_node ? m_rx_node->GetId() : 0) << "): " << m_lookups << " lookups, "
+       << m_computed << " effective SNRs computed" << std::endl;
+}
+
+} // namespace ns3
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#ifndef SIONNA_ERROR_RATE_MODEL_H
+#define SIONNA_ERROR_RATE_MODEL_H
+
+#include "sionna-propagation-cache.h"
+
+#include "ns3/error-rate-model.h"
+#include "ns3/nist-error-rate-model.h"
+#include "ns3/wifi-mac-header.h"
+#include "ns3/wifi-phy.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * @brief Wi-Fi error rate model using the per subcarrier CSI of the link from the SionnaPropagationCache.
+ *
+ * The wideband SNR of the data field is mapped to an effective SNR by the exponential effective SNR mapping
+ * (EESM) over the shape |H_k|^2 / mean(|H|^2) of the CSI, with beta per modulation and coding rate; the
+ * PER of the effective SNR is given by the NistErrorRateModel. Each instance belongs to one PHY (see
+ * AttachToPhy) and tracks the TX of the current reception by the TA of the received MAC header. Frames
+ * without TA (ACK, CTS) and links without CSI use the wideband SNR.
+ */
+class SionnaErrorRateModel : public ErrorRateModel
+{
+    public:
+        static TypeId GetTypeId();
+
+        SionnaErrorRateModel();
+        ~SionnaErrorRateModel() override;
+
+        void SetPropagationCache(Ptr<SionnaPropagationCache> propagationCache);
+
+        // band of the SionnaHelper the PHY operates in (default: 0)
+        void SetBand(uint32_t band);
+
+        // installs this model as error rate model of the PHY and connects to its PhyRxMacHeaderEnd trace
+        void AttachToPhy(Ptr<WifiPhy> phy);
+
+        void NotifyRxMacHeaderEnd(const WifiMacHeader& hdr, const WifiTxVector& txVector, Time psduDuration);
+
+        // EESM beta of the modulation and coding rate of the mode
+        static double GetBeta(WifiMode mode);
+
+        void PrintStats(std::ostream& os) const;
+
+    private:
+        double DoGetChunkSuccessRate(WifiMode mode,
+                                     const WifiTxVector& txVector,
+                                     double snr,
+                                     uint64_t nbits,
+                                     uint8_t numRxAntennas,
+                                     WifiPpduField field,
+                                     uint16_t staId) const override;
+
+        // effective SNR (linear) of the wideband SNR on the current link; snr if the link has no CSI
+        double GetEffectiveSnr(WifiMode mode, double snr) const;
+
+        // CSI shape of a window and the effective SNRs computed on it
+        struct LinkState
+        {
+            Time m_start_time;
+            std::vector<double> m_gain; // |H_k|^2 / mean(|H|^2)
+            double m_min_gain;
+            // (mode, wideband SNR in 0.1 dB) -> effective SNR / wideband SNR
+            std::map<std::pair<uint32_t, int64_t>, double> m_ratio;
+        };
+
+        Ptr<NistErrorRateModel> m_nistModel;
+        Ptr<SionnaPropagationCache> m_propagationCache;
+        uint32_t m_band;
+        Ptr<Node> m_rx_node;
+        Ptr<Node> m_tx_node; // TX of the current reception; nullptr if unknown
+        mutable std::map<uint32_t, LinkState> m_links; // per TX node
+        mutable double m_lookups;
+        mutable double m_computed;
+};
+
+} // namespace ns3
+
+#endif // SIONNA_ERROR_RATE_MODEL_H
@@ -9,6 +9,8 @@
 #include "sionna-helper.h"
 
 #include "sionna-mobility-model.h"
+#include "sionna-propagation-cache.h"
+#include "sionna-scene-geometry.h"
 
 #include "ns3/core-module.h"
 #include "ns3/mobility-module.h"
@@ -20,7 +22,7 @@ namespace ns3
 NS_LOG_COMPONENT_DEFINE("SionnaHelper");
 
 SionnaHelper::SionnaHelper(std::string environment, std::string zmq_url): m_environment(environment),
-    m_mode(MODE_P2MP_LAH), m_sub_mode(1), m_zmq_context(1), m_zmq_socket(m_zmq_context, ZMQ_REQ)
+    m_mode(MODE_P2MP_LAH), m_sub_mode(1), m_reply_first(false), m_report_timing(false), m_loss_delay_only(false), m_path_response(false), m_zmq_context(1), m_warm_start_cache(nullptr), m_offline(false), m_connected(true), m_client_mobility(false), m_mobility_geometry(nullptr), m_trajectory_horizon(Seconds(1)), m_zmq_socket(m_zmq_context, ZMQ_REQ), m_reply_pending(false)
 {
     // Connect
     m_zmq_socket.connect(zmq_url);
@@ -77,6 +79,75 @@ SionnaHelper::SetSubMode(int sub_mode)
     m_sub_mode = sub_mode;
 }
 
+void
+SionnaHelper::SetReplyFirst(bool reply_first)
+{
+    m_reply_first = reply_first;
+}
+
+void
+SionnaHelper::SetReportTiming(bool report_timing)
+{
+    m_report_timing = report_timing;
+}
+
+void
+SionnaHelper::SetLossDelayOnly(bool loss_delay_only)
+{
+    m_loss_delay_only = loss_delay_only;
+}
+
+void
+SionnaHelper::SetPathResponse(bool path_response)
+{
+    m_path_response = path_response;
+}
+
+void
+SionnaHelper::SetWarmStart(Ptr<SionnaPropagationCache> cache, bool offline)
+{
+    m_warm_start_cache = cache;
+    m_offline = offline;
+}
+
+bool
+SionnaHelper::IsConnected()
+{
+    return m_connected;
+}
+
+void
+SionnaHelper::SetClientMobility(Ptr<SionnaSceneGeometry> geometry, Time horizon)
+{
+    m_client_mobility = true;
+    m_mobility_geometry = geometry;
+    m_trajectory_horizon = horizon;
+}
+
+bool
+SionnaHelper::GetClientMobility()
+{
+    return m_client_mobility;
+}
+
+Time
+SionnaHelper::GetTrajectoryHorizon()
+{
+    return m_trajectory_horizon;
+}
+
+bool
+SionnaHelper::GetLossDelayOnly()
+{
+    return m_loss_delay_only;
+}
+
+bool
+SionnaHelper::GetPathResponse()
+{
+    return m_path_response;
+}
+
 void
 SionnaHelper::Configure(double frequency, double channel_bw)
 {
@@ -85,12 +156,64 @@ SionnaHelper::Configure(double frequency, double channel_bw)
     SetFFTSize(64 * (channel_bw/20e6)); // AZU: todo make configureable
 }
 
+uint32_t
+SionnaHelper::AddBand(double frequency, double channel_bw)
+{
+    m_bands.push_back({frequency, channel_bw, static_cast<int>(64 * (channel_bw/20e6))});
+    return m_bands.size();
+}
+
 double
 SionnaHelper::GetNoiseFloor()
 {
     return m_noiseDbm;
 }
 
+double
+SionnaHelper::GetFrequency()
+{
+    return m_frequency;
+}
+
+double
+SionnaHelper::GetChannelBandwidth()
+{
+    return m_channel_bw;
+}
+
+int
+SionnaHelper::GetFFTSize()
+{
+    return m_fft_size;
+}
+
+uint32_t
+SionnaHelper::GetNBands()
+{
+    return 1 + m_bands.size();
+}
+
+double
+SionnaHelper::GetBandFrequency(uint32_t band)
+{
+    NS_ASSERT_MSG(band < GetNBands(), "Band " << band << " is not configured.");
+    return band == 0 ? m_frequency : m_bands[band - 1].m_frequency;
+}
+
+double
+SionnaHelper::GetBandChannelBandwidth(uint32_t band)
+{
+    NS_ASSERT_MSG(band < GetNBands(), "Band " << band << " is not configured.");
+    return band == 0 ? m_channel_bw : m_bands[band - 1].m_channel_bw;
+}
+
+int
+SionnaHelper::GetBandFFTSize(uint32_t band)
+{
+    NS_ASSERT_MSG(band < GetNBands(), "Band " << band << " is not configured.");
+    return band == 0 ? m_fft_size : m_bands[band - 1].m_fft_size;
+}
+
 void
 SionnaHelper::RandomVariableStreamMessage(ns3sionna::SimInitMessage::NodeInfo::RandomWalkModel::RandomVariableStream* message,
                             Ptr<RandomVariableStream> random_variable)
@@ -137,6 +260,18 @@ SionnaHelper::Start()
     simulation_info->set_fft_size(m_fft_size);
     simulation_info->set_mode(m_mode);
     simulation_info->set_sub_mode(m_sub_mode);
+    simulation_info->set_reply_first(m_reply_first);
+    simulation_info->set_report_timing(m_report_timing);
+    simulation_info->set_loss_delay_only(m_loss_delay_only);
+    simulation_info->set_path_response(m_path_response);
+    simulation_info->set_client_mobility(m_client_mobility);
+    for (const auto& band : m_bands)
+    {
+        ns3sionna::SimInitMessage::BandConfig* band_config = simulation_info->add_bands();
+        band_config->set_frequency(band.m_frequency);
+        band_config->set_channel_bw(band.m_channel_bw);
+        band_config->set_fft_size(band.m_fft_size);
+    }
 
     NodeContainer c = NodeContainer::GetGlobal();
     for (auto iter = c.Begin(); iter != c.End(); ++iter)
@@ -181,6 +316,11 @@ SionnaHelper::Start()
                 
                 ns3sionna::SimInitMessage::NodeInfo::RandomWalkModel::RandomVariableStream* direction = random_walk_model->mutable_direction();
                 RandomVariableStreamMessage(direction, sionnaMobilityModel->GetDirection());
+
+                if (m_client_mobility)
+                {
+                    sionnaMobilityModel->EnableWalk(m_mobility_geometry);
+                }
             }
             else
             {
@@ -213,11 +353,44 @@ SionnaHelper::Start()
     reply_wrapper.ParseFromArray(zmq_reply.data(), zmq_reply.size());
     
     NS_ASSERT_MSG(reply_wrapper.has_sim_ack(), "Reply after simulation information is not an ack.");
+
+    std::cout << "Sionna scene ready in " << reply_wrapper.sim_ack().scene_load_time() << " sec"
+              << (reply_wrapper.sim_ack().scene_cached() ? " (cached)" : "")
+              << (reply_wrapper.sim_ack().loss_delay_only() ? ", loss and delay only" : "")
+              << (reply_wrapper.sim_ack().path_response() ? ", path response" : "")
+              << (reply_wrapper.sim_ack().client_mobility() ? ", client mobility" : "")
+              << (m_bands.empty() ? "" : ", " + std::to_string(GetNBands()) + " bands") << std::endl;
+    NS_ASSERT_MSG(reply_wrapper.sim_ack().loss_delay_only() == m_loss_delay_only,
+                  "Sionna server does not support the loss and delay only mode.");
+    NS_ASSERT_MSG(reply_wrapper.sim_ack().path_response() == m_path_response,
+                  "Sionna server does not support the path response mode.");
+    NS_ASSERT_MSG(reply_wrapper.sim_ack().num_bands() == GetNBands() || m_bands.empty(),
+                  "Sionna server does not support multiple bands.");
+    NS_ASSERT_MSG(reply_wrapper.sim_ack().client_mobility() == m_client_mobility,
+                  "Sionna server does not support client mobility.");
+
+    if (m_warm_start_cache)
+    {
+        m_warm_start_cache->WarmStart(m_offline);
+    }
 }
 
 void
 SionnaHelper::Destroy()
 {
+    if (!m_connected)
+    {
+        return;
+    }
+    if (m_reply_pending)
+    {
+        // the reply of a prefetch is not needed anymore
+        zmq::message_t zmq_pending_reply;
+        zmq::recv_result_t pending_result = m_zmq_socket.recv(zmq_pending_reply, zmq::recv_flags::none);
+        NS_ASSERT_MSG(pending_result, "Failed to receive the pending reply.");
+        m_reply_pending = false;
+    }
+
     // Prepare the request message
     ns3sionna::Wrapper wrapper;
     wrapper.mutable_sim_close_request();
@@ -244,6 +417,7 @@ SionnaHelper::Destroy()
 
     // Close socket
     m_zmq_socket.close();
+    m_connected = false;
     std::cout << "Ns3-sionna ZMQ socket closed." << std::endl;
 }
 
@@ -11,6 +11,7 @@
 
 #include "message.pb.h"
 
+#include "ns3/nstime.h"
 #include "ns3/ptr.h"
 #include "ns3/random-variable-stream.h"
 
@@ -19,6 +20,9 @@
 namespace ns3
 {
 
+class SionnaPropagationCache;
+class SionnaSceneGeometry;
+
 class SionnaHelper
 {
 public:
@@ -32,16 +36,62 @@ public:
 
   void Configure(double frequency, double channel_bw);
 
+  // adds a further band to the session, e.g. of a second radio; Sionna traces the paths once and computes the
+  // channel of every band from them. Returns the index of the band (band 0 is the one of Configure).
+  uint32_t AddBand(double frequency, double channel_bw);
+
   void Start();
 
+  // closes the Sionna session; further calls have no effect
   void Destroy();
 
+  // Start loads all links between static nodes into the cache in a single call (see SionnaPropagationCache::WarmStart);
+  // if offline, the session is closed right after, i.e. the simulation runs without Sionna
+  void SetWarmStart(Ptr<SionnaPropagationCache> cache, bool offline = false);
+
+  bool IsConnected();
+
+  // the random walks are computed by the SionnaMobilityModels with the walls of the geometry (nullptr: no walls)
+  // instead of by Sionna; each request carries the trajectories of the walking nodes until the horizon
+  void SetClientMobility(Ptr<SionnaSceneGeometry> geometry, Time horizon = Seconds(1));
+
+  bool GetClientMobility();
+
+  Time GetTrajectoryHorizon();
+
   void SetMode(int mode);
 
   void SetSubMode(int sub_mode);
 
+  void SetReplyFirst(bool reply_first);
+
+  void SetReportTiming(bool report_timing);
+
+  void SetLossDelayOnly(bool loss_delay_only);
+
+  // Sionna sends the paths of each link instead of CSI; the propagation cache synthesizes the channel over time
+  void SetPathResponse(bool path_response);
+
+  bool GetLossDelayOnly();
+
+  bool GetPathResponse();
+
   double GetNoiseFloor();
 
+  double GetFrequency();
+
+  double GetChannelBandwidth();
+
+  int GetFFTSize();
+
+  uint32_t GetNBands();
+
+  double GetBandFrequency(uint32_t band);
+
+  double GetBandChannelBandwidth(uint32_t band);
+
+  int GetBandFFTSize(uint32_t band);
+
 private:
   void SetFrequency(double frequency);
   void SetChannelBandwidth(double channel_bw);
@@ -51,14 +101,34 @@ private:
   std::string m_environment;
   int m_mode; // 1=P2P, 2=P2MP, 3=P2MP=LAH
   int m_sub_mode; // used by mode 3
+  bool m_reply_first; // used by mode 2/3: requested link is returned first, remaining links are computed in background
+  bool m_report_timing; // Sionna reports the time per processing phase
+  bool m_loss_delay_only; // only wideband loss and delay are needed, i.e. Sionna skips the OFDM channel (no CSI)
+  bool m_path_response; // path gain, delay and Doppler per link instead of CSI
   zmq::context_t m_zmq_context;
   double m_frequency;
   double m_channel_bw;
   int m_fft_size;
   double m_noiseDbm;
 
+  struct Band
+  {
+    double m_frequency;
+    double m_channel_bw;
+    int m_fft_size;
+  };
+  std::vector<Band> m_bands; // further bands, i.e. band i is m_bands[i - 1]
+  Ptr<SionnaPropagationCache> m_warm_start_cache; // nullptr: no warm start
+  bool m_offline;
+  bool m_connected;
+  bool m_client_mobility;
+  Ptr<SionnaSceneGeometry> m_mobility_geometry;
+  Time m_trajectory_horizon;
+
 public:
   zmq::socket_t m_zmq_socket;
+  // a request was sent without waiting for its reply (e.g. prefetch); the reply must be received before the next request
+  bool m_reply_pending;
 
   // possible modes of operation
   static const int MODE_P2P = 1; // only a single P2P is computed within a single Sionna call
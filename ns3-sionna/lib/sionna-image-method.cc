@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#include "sionna-image-method.h"
+
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("SionnaImageMethodEngine");
+
+NS_OBJECT_ENSURE_REGISTERED(SionnaImageMethodEngine);
+
+namespace
+{
+
+const double SPEED_OF_LIGHT = 299792458.0;
+
+double
+Dot(const Vector& a, const Vector& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+Vector
+Cross(const Vector& a, const Vector& b)
+{
+    return Vector(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+Vector
+Scale(const Vector& a, double s)
+{
+    return Vector(a.x * s, a.y * s, a.z * s);
+}
+
+Vector
+Normalize(const Vector& a)
+{
+    return Scale(a, 1.0 / a.GetLength());
+}
+
+// field vector of a vertically polarized isotropic antenna in direction k, i.e. theta unit vector
+Vector
+ThetaHat(const Vector& k)
+{
+    double theta = std::acos(std::max(-1.0, std::min(1.0, k.z)));
+    double phi = std::atan2(k.y, k.x);
+    return Vector(std::cos(theta) * std::cos(phi), std::cos(theta) * std::sin(phi), -std::sin(theta));
+}
+
+// complex field vector, i.e. one complex amplitude per axis
+struct Field
+{
+    std::complex<double> x;
+    std::complex<double> y;
+    std::complex<double> z;
+
+    std::complex<double> Dot(const Vector& v) const
+    {
+        return x * v.x + y * v.y + z * v.z;
+    }
+};
+
+} // namespace
+
+TypeId
+SionnaImageMethodEngine::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::SionnaImageMethodEngine")
+            .SetParent<Object>()
+            .SetGroupName("Propagation")
+            .AddConstructor<SionnaImageMethodEngine>()
+            .AddAttribute("MaxOrder",
+                          "The max. no. of reflections per path (0: LOS only).",
+                          UintegerValue(2),
+                          MakeUintegerAccessor(&SionnaImageMethodEngine::m_max_order),
+                          MakeUintegerChecker<uint32_t>(0, 3))
+            .AddAttribute("NumThreads",
+                          "The no. of threads used by ComputeLinks (0: no. of cores).",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&SionnaImageMethodEngine::m_num_threads),
+                          MakeUintegerChecker<uint32_t>());
+    return tid;
+}
+
+SionnaImageMethodEngine::SionnaImageMethodEngine()
+    : m_frequency(0),
+      m_channel_bw(0),
+      m_fft_size(0)
+{
+}
+
+SionnaImageMethodEngine::~SionnaImageMethodEngine()
+{
+}
+
+void
+SionnaImageMethodEngine::SetSceneGeometry(Ptr<SionnaSceneGeometry> geometry)
+{
+    m_geometry = geometry;
+    m_planes = geometry->GetPlanes();
+    NS_LOG_INFO("ImageMethod:: " << m_planes.size() << " planes in " << geometry->GetNTriangles() << " triangles");
+    UpdatePermittivity();
+}
+
+void
+SionnaImageMethodEngine::Configure(double frequency, double channelBw, int fftSize)
+{
+    m_frequency = frequency;
+    m_channel_bw = channelBw;
+    m_fft_size = fftSize;
+    UpdatePermittivity();
+}
+
+bool
+SionnaImageMethodEngine::IsConfigured() const
+{
+    return m_geometry && m_frequency > 0 && m_fft_size > 0;
+}
+
+void
+SionnaImageMethodEngine::UpdatePermittivity()
+{
+    m_plane_permittivity.clear();
+    if (!m_geometry || m_frequency <= 0)
+    {
+        return;
+    }
+    for (const auto& plane : m_planes)
+    {
+        m_plane_permittivity.push_back(
+            GetRelativePermittivity(m_geometry->GetMaterialName(plane.m_material), m_frequency));
+    }
+}
+
+std::complex<double>
+SionnaImageMethodEngine::GetRelativePermittivity(const std::string& material, double frequency)
+{
+    // ITU-R P.2040-2 Table 3: eta = a * f^b - j 17.98 * c * f^d / f (f in GHz), as used by Sionna
+    struct ItuMaterial
+    {
+        const char* m_name;
+        double a;
+        double b;
+        double c;
+        double d;
+    };
+
+    static const ItuMaterial materials[] = {
+        {"itu_vacuum", 1, 0, 0, 0},
+        {"itu_concrete", 5.24, 0, 0.0462, 0.7822},
+        {"itu_brick", 3.91, 0, 0.0238, 0.16},
+        {"itu_plasterboard", 2.73, 0, 0.0085, 0.9395},
+        {"itu_wood", 1.99, 0, 0.0047, 1.0718},
+        {"itu_glass", 6.31, 0, 0.0036, 1.3394},
+        {"itu_ceiling_board", 1.48, 0, 0.0011, 1.075},
+        {"itu_chipboard", 2.58, 0, 0.0217, 0.78},
+        {"itu_plywood", 2.71, 0, 0.33, 0},
+        {"itu_marble", 7.074, 0, 0.0055, 0.9262},
+        {"itu_floorboard", 3.66, 0, 0.0044, 1.3515},
+        {"itu_metal", 1, 0, 1e7, 0},
+        {"itu_very_dry_ground", 3, 0, 0.00015, 2.52},
+        {"itu_medium_dry_ground", 15, -0.1, 0.035, 1.63},
+        {"itu_wet_ground", 30, -0.4, 0.15, 1.30},
+    };
+
+    // unknown materials are treated as concrete
+    const ItuMaterial* m = &materials[1];
+    for (const auto& entry : materials)
+    {
+        if (material == entry.m_name)
+        {
+            m = &entry;
+            break;
+        }
+    }
+    if (m == &materials[1] && material != "itu_concrete")
+    {
+        NS_LOG_WARN("ImageMethod:: unknown material " << material << ", using concrete");
+    }
+
+    double f = frequency / 1e9;
+    return std::complex<double>(m->a * std::pow(f, m->b), -17.98 * m->c * std::pow(f, m->d) / f);
+}
+
+SionnaImageMethodEngine::Result
+SionnaImageMethodEngine::ComputeLink(const Vector& txPos, const Vector& rxPos) const
+{
+    NS_ASSERT_MSG(IsConfigured(), "SionnaImageMethodEngine needs a scene geometry and Configure()");
+
+    // (length, gain incl. antenna patterns and Fresnel coefficients) per path
+    std::vector<std::pair<double, std::complex<double>>> paths;
+
+    if (m_geometry->IsLos(txPos, rxPos))
+    {
+        paths.emplace_back((rxPos - txPos).GetLength(), 1.0);
+    }
+
+    std::vector<uint32_t> planes(m_max_order);
+    for (uint32_t order = 1; order <= m_max_order; order++)
+    {
+        AddReflections(txPos, rxPos, planes, 0, order, paths);
+    }
+
+    Result result;
+    result.m_num_paths = paths.size();
+    if (paths.empty())
+    {
+        result.m_delay = Time(0);
+        result.m_loss = 0;
+        return result;
+    }
+
+    // discrete baseband channel frequency response as computed by Sionna via cir_to_ofdm_channel
+    double wavelength = SPEED_OF_LIGHT / m_frequency;
+    double spacing = m_channel_bw / m_fft_size;
+    double min_length = paths[0].first;
+    std::vector<std::pair<double, std::complex<double>>> taps; // (delay, amplitude)
+    for (const auto& path : paths)
+    {
+        double length = path.first;
+        min_length = std::min(min_length, length);
+        std::complex<double> a = wavelength / (4 * M_PI * length) * path.second *
+                                 std::polar(1.0, -2 * M_PI * length / wavelength);
+        taps.emplace_back(length / SPEED_OF_LIGHT, a);
+    }
+
+    result.m_csi.resize(m_fft_size);
+    double power = 0;
+    for (int k = 0; k < m_fft_size; k++)
+    {
+        double f_k = (k - m_fft_size / 2) * spacing;
+        std::complex<double> h = 0;
+        for (const auto& tap : taps)
+        {
+            h += tap.second * std::polar(1.0, -2 * M_PI * f_k * tap.first);
+        }
+        result.m_csi[k] = h;
+        power += std::norm(h);
+    }
+    power /= m_fft_size;
+
+    result.m_loss = -10 * std::log10(power);
+    result.m_delay = NanoSeconds(std::llround(min_length / SPEED_OF_LIGHT * 1e9));
+    return result;
+}
+
+std::vector<SionnaImageMethodEngine::Result>
+SionnaImageMethodEngine::ComputeLinks(const std::vector<std::pair<Vector, Vector>>& links) const
+{
+    std::vector<Result> results(links.size());
+
+    uint32_t num_threads = m_num_threads > 0 ? m_num_threads : std::thread::hardware_concurrency();
+    num_threads = std::max(1u, std::min<uint32_t>(num_threads, links.size()));
+    if (num_threads == 1)
+    {
+        for (size_t i = 0; i < links.size(); i++)
+        {
+            results[i] = ComputeLink(links[i].first, links[i].second);
+        }
+        return results;
+    }
+
+    // the geometry is read-only, so the links are simply distributed over the threads
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < links.size(); i = next++)
+        {
+            results[i] = ComputeLink(links[i].first, links[i].second);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < num_threads; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    return results;
+}
+
+void
+SionnaImageMethodEngine::AddReflections(const Vector& txPos, const Vector& rxPos, std::vector<uint32_t>& planes,
+                                        uint32_t depth, uint32_t order,
+                                        std::vector<std::pair<double, std::complex<double>>>& paths) const
+{
+    if (depth == order)
+    {
+        std::vector<uint32_t> sequence(planes.begin(), planes.begin() + order);
+        double length;
+        std::complex<double> gain;
+        if (TracePath(txPos, rxPos, sequence, length, gain))
+        {
+            paths.emplace_back(length, gain);
+        }
+        return;
+    }
+    for (uint32_t plane = 0; plane < m_planes.size(); plane++)
+    {
+        // a second reflection on the same plane is impossible
+        if (depth > 0 && planes[depth - 1] == plane)
+        {
+            continue;
+        }
+        planes[depth] = plane;
+        AddReflections(txPos, rxPos, planes, depth + 1, order, paths);
+    }
+}
+
+bool
+SionnaImageMethodEngine::TracePath(const Vector& txPos, const Vector& rxPos, const std::vector<uint32_t>& planes,
+                                   double& length, std::complex<double>& gain) const
+{
+    const size_t n = planes.size();
+
+    // mirror images of the TX
+    std::vector<Vector> images(n + 1);
+    images[0] = txPos;
+    for (size_t i = 0; i < n; i++)
+    {
+        const auto& plane = m_planes[planes[i]];
+        double dist = Dot(plane.m_normal, images[i]) - plane.m_offset;
+        images[i + 1] = images[i] - Scale(plane.m_normal, 2 * dist);
+    }
+
+    // reflection points from the RX backwards: intersection of image -> next point with the plane
+    std::vector<Vector> points(n + 2);
+    points[0] = txPos;
+    points[n + 1] = rxPos;
+    for (size_t i = n; i-- > 0;)
+    {
+        const auto& plane = m_planes[planes[i]];
+        Vector d = points[i + 2] - images[i + 1];
+        double denom = Dot(plane.m_normal, d);
+        if (std::fabs(denom) < 1e-12)
+        {
+            return false;
+        }
+        double s = (plane.m_offset - Dot(plane.m_normal, images[i + 1])) / denom;
+        if (s <= 0 || s >= 1)
+        {
+            // image and next point on the same side of the plane
+            return false;
+        }
+        points[i + 1] = images[i + 1] + Scale(d, s);
+    }
+
+    // each leg must end on a triangle of the plane (i.e. not only on the infinite plane) without being blocked
+    for (size_t i = 0; i < n; i++)
+    {
+        const auto& plane = m_planes[planes[i]];
+        Vector leg = points[i + 1] - points[i];
+        double dist = leg.GetLength();
+        double tolerance = 1e-3 + 1e-5 * dist;
+        SionnaSceneGeometry::Hit hit;
+        if (dist < tolerance ||
+            !m_geometry->Intersect(points[i], Scale(leg, 1.0 / dist), dist + tolerance, hit) ||
+            std::fabs(hit.m_t - dist) > tolerance || hit.m_material != plane.m_material ||
+            std::fabs(Dot(hit.m_normal, plane.m_normal)) < 0.999)
+        {
+            return false;
+        }
+    }
+    if (!m_geometry->IsLos(points[n], rxPos))
+    {
+        return false;
+    }
+
+    // vertically polarized field along the path; Fresnel coefficients per reflection
+    Vector k = Normalize(points[1] - points[0]);
+    Vector e0 = ThetaHat(k);
+    Field field{e0.x, e0.y, e0.z};
+    length = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        length += (points[i + 1] - points[i]).GetLength();
+
+        const auto& plane = m_planes[planes[i]];
+        Vector k_r = Normalize(points[i + 2] - points[i + 1]);
+        double cos_theta = std::min(1.0, std::fabs(Dot(k, plane.m_normal)));
+        double sin2_theta = 1 - cos_theta * cos_theta;
+        std::complex<double> eta = m_plane_permittivity[planes[i]];
+        std::complex<double> root = std::sqrt(eta - sin2_theta);
+        std::complex<double> gamma_s = (cos_theta - root) / (cos_theta + root);
+        std::complex<double> gamma_p = (eta * cos_theta - root) / (eta * cos_theta + root);
+
+        // s: perpendicular to the plane of incidence; p: in the plane of incidence, before and after
+        Vector s = Cross(k, plane.m_normal);
+        if (s.GetLength() < 1e-9)
+        {
+            // normal incidence: any direction perpendicular to k
+            s = Cross(k, std::fabs(k.z) < 0.9 ? Vector(0, 0, 1) : Vector(1, 0, 0));
+        }
+        s = Normalize(s);
+        Vector p_i = Cross(s, k);
+        Vector p_r = Cross(s, k_r);
+
+        std::complex<double> e_s = gamma_s * field.Dot(s);
+        std::complex<double> e_p = gamma_p * field.Dot(p_i);
+        field = Field{e_s * s.x + e_p * p_r.x, e_s * s.y + e_p * p_r.y, e_s * s.z + e_p * p_r.z};
+        k = k_r;
+    }
+    length += (rxPos - points[n]).GetLength();
+
+    gain = field.Dot(ThetaHat(k));
+    return true;
+}
+
+} // namespace ns3
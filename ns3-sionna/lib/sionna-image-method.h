@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#ifndef SIONNA_IMAGE_METHOD_H
+#define SIONNA_IMAGE_METHOD_H
+
+#include "sionna-scene-geometry.h"
+
+#include "ns3/nstime.h"
+#include "ns3/object.h"
+#include "ns3/vector.h"
+
+#include <complex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * @brief Native image-method ray tracer on the scene geometry: LOS and specular reflections up to
+ * MaxOrder, each validated against the BVH, with Fresnel coefficients of the ITU materials.
+ *
+ * Antennas are isotropic and vertically polarized as in the Sionna server (iso pattern, synthetic
+ * array). Diffraction and scattering are not modeled, so it is a fast local approximation of Sionna
+ * for rooms with few planes rather than a replacement; larger scenes should keep MaxOrder at 1.
+ */
+class SionnaImageMethodEngine : public Object
+{
+    public:
+        static TypeId GetTypeId();
+
+        SionnaImageMethodEngine();
+        ~SionnaImageMethodEngine() override;
+
+        void SetSceneGeometry(Ptr<SionnaSceneGeometry> geometry);
+
+        // center frequency and bandwidth (in Hz) and no. of subcarriers of the CSI, i.e. as configured in Sionna
+        void Configure(double frequency, double channelBw, int fftSize);
+
+        bool IsConfigured() const;
+
+        struct Result
+        {
+            Time m_delay; // of the shortest path
+            double m_loss; // wideband loss (in dB)
+            std::vector<std::complex<double>> m_csi; // per subcarrier, -fftSize/2 ... fftSize/2-1
+            uint32_t m_num_paths; // 0 if no path was found, i.e. the result is invalid
+        };
+
+        Result ComputeLink(const Vector& txPos, const Vector& rxPos) const;
+
+        // computes the links (tx position, rx position) in parallel on NumThreads threads
+        std::vector<Result> ComputeLinks(const std::vector<std::pair<Vector, Vector>>& links) const;
+
+        // complex relative permittivity of the ITU material (ITU-R P.2040) at the given frequency (in Hz)
+        static std::complex<double> GetRelativePermittivity(const std::string& material, double frequency);
+
+    private:
+        // reflection paths of the given order via the plane sequence in planes[0 .. depth)
+        void AddReflections(const Vector& txPos, const Vector& rxPos, std::vector<uint32_t>& planes, uint32_t depth,
+                            uint32_t order, std::vector<std::pair<double, std::complex<double>>>& paths) const;
+
+        // traces the path tx -> planes -> rx; false if it is blocked or does not exist
+        bool TracePath(const Vector& txPos, const Vector& rxPos, const std::vector<uint32_t>& planes,
+                       double& length, std::complex<double>& gain) const;
+
+        // permittivity of each plane at the configured frequency
+        void UpdatePermittivity();
+
+        Ptr<SionnaSceneGeometry> m_geometry;
+        std::vector<SionnaSceneGeometry::Plane> m_planes;
+        std::vector<std::complex<double>> m_plane_permittivity;
+
+        double m_frequency;
+        double m_channel_bw;
+        int m_fft_size;
+
+        uint32_t m_max_order;
+        uint32_t m_num_threads;
+};
+
+} // namespace ns3
+
+#endif // SIONNA_IMAGE_METHOD_H
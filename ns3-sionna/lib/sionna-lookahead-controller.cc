@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#include "sionna-lookahead-controller.h"
+
+#include "ns3/double.h"
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("SionnaLookAheadController");
+
+NS_OBJECT_ENSURE_REGISTERED(SionnaLookAheadController);
+
+TypeId
+SionnaLookAheadController::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::SionnaLookAheadController")
+            .SetParent<Object>()
+            .SetGroupName("Propagation")
+            .AddConstructor<SionnaLookAheadController>()
+            .AddAttribute("MinLookAhead",
+                          "The min. no. of windows computed per request.",
+                          UintegerValue(1),
+                          MakeUintegerAccessor(&SionnaLookAheadController::m_min_look_ahead),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("MaxLookAhead",
+                          "The max. no. of windows computed per request.",
+                          UintegerValue(64),
+                          MakeUintegerAccessor(&SionnaLookAheadController::m_max_look_ahead),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("Increase",
+                          "The no. of windows added to the look-ahead if the miss rate is too high.",
+                          UintegerValue(1),
+                          MakeUintegerAccessor(&SionnaLookAheadController::m_increase),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("Decrease",
+                          "The factor applied to the look-ahead if prefetched windows are not read "
+                          "or the server is too slow.",
+                          DoubleValue(0.5),
+                          MakeDoubleAccessor(&SionnaLookAheadController::m_decrease),
+                          MakeDoubleChecker<double>(0.0, 1.0))
+            .AddAttribute("TargetMissRate",
+                          "The look-ahead is increased while the miss rate of a TX is above this value.",
+                          DoubleValue(0.1),
+                          MakeDoubleAccessor(&SionnaLookAheadController::m_target_miss_rate),
+                          MakeDoubleChecker<double>(0.0, 1.0))
+            .AddAttribute("MinUsage",
+                          "The look-ahead is decreased if a smaller fraction of the prefetched windows is read.",
+                          DoubleValue(0.5),
+                          MakeDoubleAccessor(&SionnaLookAheadController::m_min_usage),
+                          MakeDoubleChecker<double>(0.0, 1.0))
+            .AddAttribute("MaxLatency",
+                          "The look-ahead is decreased if the server latency (in ms) is above this value.",
+                          DoubleValue(100.0),
+                          MakeDoubleAccessor(&SionnaLookAheadController::m_max_latency),
+                          MakeDoubleChecker<double>(0.0))
+            .AddAttribute("Smoothing",
+                          "The weight of the newest sample in the moving averages of usage and latency.",
+                          DoubleValue(0.2),
+                          MakeDoubleAccessor(&SionnaLookAheadController::m_smoothing),
+                          MakeDoubleChecker<double>(0.0, 1.0))
+            .AddTraceSource("Decision",
+                            "The look-ahead depth chosen for a transmitter.",
+                            MakeTraceSourceAccessor(&SionnaLookAheadController::m_decisionTrace),
+                            "ns3::SionnaLookAheadController::DecisionTracedCallback");
+    return tid;
+}
+
+SionnaLookAheadController::SionnaLookAheadController()
+{
+}
+
+SionnaLookAheadController::~SionnaLookAheadController()
+{
+}
+
+uint32_t
+SionnaLookAheadController::GetLookAhead(uint32_t txId)
+{
+    TxState& state = m_tx_state[txId];
+
+    double miss_rate = state.m_lookups > 0 ? state.m_misses / state.m_lookups : 1.0;
+    double usage = state.m_prefetched > 0 ? state.m_used / state.m_prefetched : 1.0;
+
+    uint32_t look_ahead = state.m_look_ahead;
+    if (usage < m_min_usage || state.m_latency > m_max_latency)
+    {
+        // windows are wasted or the server cannot keep up
+        look_ahead = static_cast<uint32_t>(look_ahead * m_decrease);
+    }
+    else if (miss_rate > m_target_miss_rate)
+    {
+        look_ahead += m_increase;
+    }
+    look_ahead = std::max(m_min_look_ahead, std::min(look_ahead, m_max_look_ahead));
+
+    if (look_ahead != state.m_look_ahead)
+    {
+        NS_LOG_INFO("LookAhead:: TX " << txId << " " << state.m_look_ahead << " -> " << look_ahead
+                    << " (miss rate: " << miss_rate << ", usage: " << usage << ", latency: " << state.m_latency
+                    << " ms)");
+    }
+    state.m_look_ahead = look_ahead;
+    m_decisionTrace(txId, look_ahead, miss_rate, usage, state.m_latency);
+
+    // start a new observation period; older prefetch outcomes fade out
+    state.m_lookups = 0;
+    state.m_misses = 0;
+    state.m_prefetched *= (1 - m_smoothing);
+    state.m_used *= (1 - m_smoothing);
+
+    return look_ahead;
+}
+
+void
+SionnaLookAheadController::NotifyLookup(uint32_t txId, bool hit)
+{
+    TxState& state = m_tx_state[txId];
+    state.m_lookups += 1;
+    if (!hit)
+    {
+        state.m_misses += 1;
+    }
+}
+
+void
+SionnaLookAheadController::NotifyPrefetchUsed(uint32_t txId)
+{
+    m_tx_state[txId].m_used += 1;
+}
+
+void
+SionnaLookAheadController::NotifyPrefetched(uint32_t txId, uint32_t windows)
+{
+    m_tx_state[txId].m_prefetched += windows;
+}
+
+void
+SionnaLookAheadController::NotifyLatency(uint32_t txId, double latencyMs)
+{
+    TxState& state = m_tx_state[txId];
+    if (state.m_latency == 0)
+    {
+        state.m_latency = latencyMs;
+    }
+    else
+    {
+        state.m_latency = m_smoothing * latencyMs + (1 - m_smoothing) * state.m_latency;
+    }
+}
+
+} // namespace ns3
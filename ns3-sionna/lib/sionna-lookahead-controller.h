@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#ifndef SIONNA_LOOKAHEAD_CONTROLLER_H
+#define SIONNA_LOOKAHEAD_CONTROLLER_H
+
+#include "ns3/nstime.h"
+#include "ns3/object.h"
+#include "ns3/traced-callback.h"
+
+#include <map>
+
+namespace ns3
+{
+
+/**
+ * @brief Closed-loop control of the look-ahead depth (no. of future windows computed by Sionna)
+ * per transmitter, replacing the static sub_mode of mode 3.
+ *
+ * The depth is increased additively while the transmitter keeps missing the cache and the
+ * server is fast enough; it is decreased multiplicatively when the prefetched windows are
+ * mostly not read or the server latency gets too high (AIMD).
+ */
+class SionnaLookAheadController : public Object
+{
+    public:
+        static TypeId GetTypeId();
+
+        SionnaLookAheadController();
+        ~SionnaLookAheadController() override;
+
+        /**
+         * Look-ahead depth to be requested for the next channel computation of the given TX;
+         * updates the depth based on what was observed since the last request of the TX.
+         */
+        uint32_t GetLookAhead(uint32_t txId);
+
+        // a lookup of the TX was answered from the cache (hit) or needs a request (miss)
+        void NotifyLookup(uint32_t txId, bool hit);
+
+        // windows (per link) of the TX received in advance, i.e. not needed by the current lookup
+        void NotifyPrefetched(uint32_t txId, uint32_t windows);
+
+        // a window received in advance was read for the first time
+        void NotifyPrefetchUsed(uint32_t txId);
+
+        // round trip time of a request of the TX
+        void NotifyLatency(uint32_t txId, double latencyMs);
+
+        /**
+         * TracedCallback signature for look-ahead decisions.
+         *
+         * @param [in] txId The transmitter.
+         * @param [in] lookAhead The new look-ahead depth.
+         * @param [in] missRate The miss rate since the last decision.
+         * @param [in] usage The smoothed fraction of prefetched windows read.
+         * @param [in] latencyMs The smoothed server latency (in ms).
+         */
+        typedef void (*DecisionTracedCallback)(uint32_t txId, uint32_t lookAhead, double missRate, double usage,
+                                               double latencyMs);
+
+    private:
+        struct TxState
+        {
+            TxState()
+                : m_look_ahead(1),
+                  m_lookups(0),
+                  m_misses(0),
+                  m_prefetched(0),
+                  m_used(0),
+                  m_latency(0)
+            {
+            }
+
+            uint32_t m_look_ahead;
+            double m_lookups; // since the last decision
+            double m_misses;
+            double m_prefetched; // smoothed over the decisions
+            double m_used;
+            double m_latency; // smoothed (in ms)
+        };
+
+        std::map<uint32_t, TxState> m_tx_state;
+
+        uint32_t m_min_look_ahead;
+        uint32_t m_max_look_ahead;
+        uint32_t m_increase; // additive increase (in windows)
+        double m_decrease; // multiplicative decrease factor
+        double m_target_miss_rate; // increase the depth above this miss rate
+        double m_min_usage; // decrease the depth if fewer prefetched windows are read
+        double m_max_latency; // (in ms)
+        double m_smoothing; // weight of the newest sample in the moving averages
+
+        TracedCallback<uint32_t, uint32_t, double, double, double> m_decisionTrace;
+};
+
+} // namespace ns3
+
+#endif // SIONNA_LOOKAHEAD_CONTROLLER_H
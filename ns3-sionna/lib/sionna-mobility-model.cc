@@ -12,8 +12,12 @@
 #include "ns3/enum.h"
 #include "ns3/log.h"
 #include "ns3/pointer.h"
+#include "ns3/simulator.h"
 #include "ns3/string.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace ns3
 {
 
@@ -71,7 +75,21 @@ SionnaMobilityModel::GetTypeId()
 }
 
 SionnaMobilityModel::SionnaMobilityModel()
+    : m_walking(false),
+      m_geometry(nullptr),
+      m_walk_time(Time(0)),
+      m_delay_left(Time(0)),
+      m_bounces(0),
+      m_stopped(false)
+{
+}
+
+void
+SionnaMobilityModel::DoDispose()
 {
+    m_event.Cancel();
+    m_geometry = nullptr;
+    MobilityModel::DoDispose();
 }
 
 SionnaMobilityModel::~SionnaMobilityModel()
@@ -140,22 +158,230 @@ SionnaMobilityModel::GetDirection() const
     return m_direction;
 }
 
+void
+SionnaMobilityModel::EnableWalk(Ptr<SionnaSceneGeometry> geometry)
+{
+    if (m_model != SionnaMobilityModel::MODEL_RANDOM_WALK)
+    {
+        return;
+    }
+    NS_ASSERT_MSG(m_mode == SionnaMobilityModel::MODE_TIME ? m_modeTime.IsStrictlyPositive() : m_modeDistance > 0.0,
+                  "Time and distance value must be greater than 0.");
+    m_walking = true;
+    m_geometry = geometry;
+    m_waypoints.clear();
+    m_walk_time = Simulator::Now();
+    m_walk_position = m_position;
+    m_stopped = false;
+    NewDirection();
+
+    m_event.Cancel();
+    m_event = Simulator::ScheduleNow(&SionnaMobilityModel::CourseChange, this);
+}
+
+bool
+SionnaMobilityModel::IsWalking() const
+{
+    return m_walking;
+}
+
+void
+SionnaMobilityModel::NewDirection() const
+{
+    double speed = m_speed->GetValue();
+    double direction = m_direction->GetValue();
+    Vector velocity = Vector(std::cos(direction) * speed, std::sin(direction) * speed, 0.0);
+
+    // Calculate the remaining time to walk in the new direction
+    if (m_mode == SionnaMobilityModel::MODE_TIME)
+    {
+        m_delay_left = m_modeTime;
+    }
+    else if (speed == 0)
+    {
+        // If speed is 0, a random walk model with mode "Distance" becomes a constant position model
+        m_stopped = true;
+        velocity = Vector(0.0, 0.0, 0.0);
+        m_delay_left = Time::Max();
+    }
+    else
+    {
+        m_delay_left = Seconds(std::abs(m_modeDistance / speed));
+    }
+    m_bounces = 0;
+    m_waypoints.push_back({m_walk_time, m_walk_position, velocity});
+    NS_LOG_DEBUG("CourseChange at " << m_walk_time << ": position " << m_walk_position << ", velocity " << velocity);
+}
+
+void
+SionnaMobilityModel::Walk(Time until) const
+{
+    while (m_walk_time < until && !m_stopped)
+    {
+        if (!m_delay_left.IsStrictlyPositive())
+        {
+            NewDirection();
+            continue;
+        }
+
+        // time to walk in this step, limited by the next direction change
+        Time leg = std::min(m_delay_left, until - m_walk_time);
+        Vector velocity = m_waypoints.back().m_velocity;
+        double speed = velocity.GetLength();
+        if (speed == 0 || m_bounces >= MAX_BOUNCES)
+        {
+            // trapped nodes stay where they are until the next direction change
+            if (speed > 0)
+            {
+                m_waypoints.push_back({m_walk_time, m_walk_position, Vector(0.0, 0.0, 0.0)});
+            }
+            m_walk_time += leg;
+            m_delay_left -= leg;
+            continue;
+        }
+
+        Vector direction = Vector(velocity.x / speed, velocity.y / speed, velocity.z / speed);
+        double distance = speed * leg.GetSeconds();
+        SionnaSceneGeometry::Hit hit;
+        if (!m_geometry || !m_geometry->Intersect(m_walk_position, direction, distance, hit))
+        {
+            // walking freely until the end of the step
+            m_walk_position = Vector(m_walk_position.x + direction.x * distance,
+                                     m_walk_position.y + direction.y * distance,
+                                     m_walk_position.z + direction.z * distance);
+            m_walk_time += leg;
+            m_delay_left -= leg;
+            continue;
+        }
+
+        // hitting a wall; the reflected direction is calculated in the z plane
+        double t = std::max(hit.m_t - WALL_OFFSET, 0.0);
+        m_walk_position = Vector(m_walk_position.x + direction.x * t,
+                                 m_walk_position.y + direction.y * t,
+                                 m_walk_position.z + direction.z * t);
+        double n_length = std::sqrt(hit.m_normal.x * hit.m_normal.x + hit.m_normal.y * hit.m_normal.y);
+        if (n_length > 0)
+        {
+            double nx = hit.m_normal.x / n_length;
+            double ny = hit.m_normal.y / n_length;
+            double dot = velocity.x * nx + velocity.y * ny;
+            velocity = Vector(velocity.x - 2 * dot * nx, velocity.y - 2 * dot * ny, 0.0);
+        }
+        else
+        {
+            velocity = Vector(-velocity.x, -velocity.y, 0.0);
+        }
+        Time dt = Seconds(t / speed);
+        m_walk_time += dt;
+        m_delay_left -= dt;
+        m_bounces += 1;
+        m_waypoints.push_back({m_walk_time, m_walk_position, velocity});
+    }
+}
+
+bool
+SionnaMobilityModel::WalkBeyond(Time time) const
+{
+    while (!m_stopped && m_waypoints.back().m_time <= time)
+    {
+        Walk(std::max(time, m_walk_time + std::max(m_delay_left, Time(0))) + NanoSeconds(1));
+    }
+    return m_waypoints.back().m_time > time;
+}
+
+const SionnaMobilityModel::Waypoint&
+SionnaMobilityModel::GetWaypoint(Time time) const
+{
+    // a direction change at the given time is included
+    Walk(time + NanoSeconds(1));
+    auto it = std::upper_bound(m_waypoints.begin(), m_waypoints.end(), time,
+                               [](Time t, const Waypoint& waypoint) { return t < waypoint.m_time; });
+    if (it != m_waypoints.begin())
+    {
+        --it;
+    }
+    return *it;
+}
+
+std::vector<SionnaMobilityModel::Waypoint>
+SionnaMobilityModel::GetTrajectory(Time start, Time end, Time& knownUntil, bool& stopped) const
+{
+    NS_ASSERT_MSG(m_walking, "The random walk is not computed by ns3.");
+    Walk(end);
+    WalkBeyond(end);
+    size_t first = &GetWaypoint(start) - m_waypoints.data();
+
+    std::vector<Waypoint> trajectory;
+    for (size_t i = first; i < m_waypoints.size(); i++)
+    {
+        trajectory.push_back(m_waypoints[i]);
+        if (m_waypoints[i].m_time > end)
+        {
+            break;
+        }
+    }
+    knownUntil = trajectory.back().m_time > end ? trajectory.back().m_time : m_walk_time;
+    stopped = m_stopped && trajectory.back().m_time <= end;
+    return trajectory;
+}
+
+void
+SionnaMobilityModel::CourseChange()
+{
+    NotifyCourseChange();
+
+    // waypoints before the current one are not needed anymore
+    Time now = Simulator::Now();
+    size_t current = &GetWaypoint(now) - m_waypoints.data();
+    m_waypoints.erase(m_waypoints.begin(), m_waypoints.begin() + current);
+    if (WalkBeyond(now))
+    {
+        m_event = Simulator::Schedule(m_waypoints[1].m_time - now, &SionnaMobilityModel::CourseChange, this);
+    }
+}
+
 Vector
 SionnaMobilityModel::DoGetPosition() const
 {
-    return m_position;
+    if (!m_walking)
+    {
+        return m_position;
+    }
+    Time now = Simulator::Now();
+    const Waypoint& waypoint = GetWaypoint(now);
+    double dt = (now - waypoint.m_time).GetSeconds();
+    return Vector(waypoint.m_position.x + waypoint.m_velocity.x * dt,
+                  waypoint.m_position.y + waypoint.m_velocity.y * dt,
+                  waypoint.m_position.z + waypoint.m_velocity.z * dt);
 }
 
 void
 SionnaMobilityModel::DoSetPosition(const Vector& position)
 {
     m_position = position;
+    if (m_walking)
+    {
+        // the walk starts again from the new position
+        EnableWalk(m_geometry);
+    }
 }
 
 Vector
 SionnaMobilityModel::DoGetVelocity() const
 {
-    return Vector(0.0, 0.0, 0.0);
+    if (!m_walking)
+    {
+        return Vector(0.0, 0.0, 0.0);
+    }
+    return GetWaypoint(Simulator::Now()).m_velocity;
+}
+
+int64_t
+SionnaMobilityModel::DoAssignStreams(int64_t stream)
+{
+    m_speed->SetStream(stream);
+    m_direction->SetStream(stream + 1);
+    return 2;
 }
 
 } // namespace ns3
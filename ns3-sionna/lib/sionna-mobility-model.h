@@ -9,11 +9,16 @@
 #ifndef SIONNA_MOBILITY_MODEL_H
 #define SIONNA_MOBILITY_MODEL_H
 
+#include "sionna-scene-geometry.h"
+
+#include "ns3/event-id.h"
 #include "ns3/mobility-model.h"
 #include "ns3/nstime.h"
 #include "ns3/ptr.h"
 #include "ns3/random-variable-stream.h"
 
+#include <vector>
+
 namespace ns3
 {
 
@@ -51,6 +56,26 @@ class SionnaMobilityModel : public MobilityModel
 
         Ptr<RandomVariableStream> GetDirection() const;
 
+        // the random walk is computed by this model from now on, i.e. Sionna does no mobility work; the walls of
+        // the geometry reflect the node like in Sionna (nullptr: no walls). See SionnaHelper::SetClientMobility.
+        void EnableWalk(Ptr<SionnaSceneGeometry> geometry);
+
+        bool IsWalking() const;
+
+        struct Waypoint
+        {
+            Time m_time;
+            Vector m_position;
+            Vector m_velocity;
+        };
+
+        // waypoints from the one valid at start until the first one after end; knownUntil: no course change
+        // other than the waypoints happens before; stopped: the node does not move after the last waypoint
+        std::vector<Waypoint> GetTrajectory(Time start, Time end, Time& knownUntil, bool& stopped) const;
+
+    protected:
+        void DoDispose() override;
+
     private:
         Vector DoGetPosition() const override;
 
@@ -58,6 +83,27 @@ class SionnaMobilityModel : public MobilityModel
 
         Vector DoGetVelocity() const override;
 
+        int64_t DoAssignStreams(int64_t stream) override;
+
+        // chooses speed and direction of a new walk segment at the current end of the walk
+        void NewDirection() const;
+
+        // walks until the given time
+        void Walk(Time until) const;
+
+        // walks until a waypoint after the given time exists; false if the node stopped before
+        bool WalkBeyond(Time time) const;
+
+        // the waypoint valid at the given time
+        const Waypoint& GetWaypoint(Time time) const;
+
+        void CourseChange();
+
+        // the intersection point is set back by one centimeter, so that it is not found behind the wall
+        static constexpr double WALL_OFFSET = 0.01;
+        // max. no. of wall bounces per walk segment; protects against nodes trapped in a corner
+        static const uint32_t MAX_BOUNCES = 100;
+
         Model m_model;
         Vector m_position;
         Mode m_mode;
@@ -66,6 +112,15 @@ class SionnaMobilityModel : public MobilityModel
         Ptr<RandomVariableStream> m_speed;
         Ptr<RandomVariableStream> m_direction;
 
+        bool m_walking;
+        Ptr<SionnaSceneGeometry> m_geometry;
+        mutable std::vector<Waypoint> m_waypoints; // computed ahead on demand
+        mutable Time m_walk_time; // end of the computed walk
+        mutable Vector m_walk_position; // position at m_walk_time
+        mutable Time m_delay_left; // time until the next direction change at m_walk_time
+        mutable uint32_t m_bounces; // in the current segment
+        mutable bool m_stopped; // speed 0 in mode distance, i.e. the node does not move anymore
+        EventId m_event;
 };
 
 } // namespace ns3
@@ -11,10 +11,17 @@
 #include "message.pb.h"
 #include "sionna-mobility-model.h"
 
+#include "ns3/config.h"
 #include "ns3/log.h"
 #include "ns3/node.h"
+#include "ns3/node-list.h"
+#include "ns3/net-device.h"
+#include "ns3/wifi-mac-header.h"
 #include "ns3/simulator.h"
-#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
 
 namespace ns3
 {
@@ -23,6 +30,107 @@ NS_LOG_COMPONENT_DEFINE("SionnaPropagationCache");
 
 NS_OBJECT_ENSURE_REGISTERED(SionnaPropagationCache);
 
+namespace
+{
+
+const double MAX_TXPOWER_DBM = 20.0; // AZU: todo: hardcoded
+
+// nodes whose position is known in ns3, i.e. not moved by Sionna
+bool
+IsStatic(Ptr<SionnaMobilityModel> mobility)
+{
+    return mobility->GetModel() == "Constant Position";
+}
+
+// normalized correlation of two CFRs
+double
+GetCsiCorrelation(const std::vector<std::complex<double>>& csi, const std::vector<std::complex<double>>& other)
+{
+    std::complex<double> cross = 0;
+    double power = 0;
+    double other_power = 0;
+    for (size_t i = 0; i < csi.size() && i < other.size(); i++)
+    {
+        cross += csi[i] * std::conj(other[i]);
+        power += std::norm(csi[i]);
+        other_power += std::norm(other[i]);
+    }
+    return (power > 0 && other_power > 0) ? std::abs(cross) / std::sqrt(power * other_power) : 0;
+}
+
+// inclusive ranges of HE tones (78.125 kHz spacing) relative to the center of the PPDU
+typedef std::vector<std::pair<int32_t, int32_t>> ToneRanges;
+
+// 802.11ax tone plan: the tones of each RU of a PPDU of the given width (20/40/80/160 MHz)
+const std::vector<ToneRanges>&
+GetRuTones(uint16_t width, int ruType)
+{
+    static std::map<std::pair<uint16_t, int>, std::vector<ToneRanges>> tones = {
+        {{20, SionnaPropagationCache::RU_26_TONE},
+         {{{-121, -96}}, {{-95, -70}}, {{-68, -43}}, {{-42, -17}}, {{-16, -4}, {4, 16}}, {{17, 42}}, {{43, 68}},
+          {{70, 95}}, {{96, 121}}}},
+        {{20, SionnaPropagationCache::RU_52_TONE}, {{{-121, -70}}, {{-68, -17}}, {{17, 68}}, {{70, 121}}}},
+        {{20, SionnaPropagationCache::RU_106_TONE}, {{{-122, -17}}, {{17, 122}}}},
+        {{20, SionnaPropagationCache::RU_242_TONE}, {{{-122, -2}, {2, 122}}}},
+        {{40, SionnaPropagationCache::RU_26_TONE},
+         {{{-243, -218}}, {{-217, -192}}, {{-189, -164}}, {{-163, -138}}, {{-136, -111}}, {{-109, -84}},
+          {{-83, -58}}, {{-55, -30}}, {{-29, -4}}, {{4, 29}}, {{30, 55}}, {{58, 83}}, {{84, 109}}, {{111, 136}},
+          {{138, 163}}, {{164, 189}}, {{192, 217}}, {{218, 243}}}},
+        {{40, SionnaPropagationCache::RU_52_TONE},
+         {{{-243, -192}}, {{-189, -138}}, {{-109, -58}}, {{-55, -4}}, {{4, 55}}, {{58, 109}}, {{138, 189}},
+          {{192, 243}}}},
+        {{40, SionnaPropagationCache::RU_106_TONE}, {{{-243, -138}}, {{-109, -4}}, {{4, 109}}, {{138, 243}}}},
+        {{40, SionnaPropagationCache::RU_242_TONE}, {{{-244, -3}}, {{3, 244}}}},
+        {{40, SionnaPropagationCache::RU_484_TONE}, {{{-244, -3}, {3, 244}}}},
+        {{80, SionnaPropagationCache::RU_26_TONE},
+         {{{-499, -474}}, {{-473, -448}}, {{-445, -420}}, {{-419, -394}}, {{-392, -367}}, {{-365, -340}},
+          {{-339, -314}}, {{-311, -286}}, {{-285, -260}}, {{-257, -232}}, {{-231, -206}}, {{-203, -178}},
+          {{-177, -152}}, {{-150, -125}}, {{-123, -98}}, {{-97, -72}}, {{-69, -44}}, {{-43, -18}},
+          {{-16, -4}, {4, 16}}, {{18, 43}}, {{44, 69}}, {{72, 97}}, {{98, 123}}, {{125, 150}}, {{152, 177}},
+          {{178, 203}}, {{206, 231}}, {{232, 257}}, {{260, 285}}, {{286, 311}}, {{314, 339}}, {{340, 365}},
+          {{367, 392}}, {{394, 419}}, {{420, 445}}, {{448, 473}}, {{474, 499}}}},
+        {{80, SionnaPropagationCache::RU_52_TONE},
+         {{{-499, -448}}, {{-445, -394}}, {{-365, -314}}, {{-311, -260}}, {{-257, -206}}, {{-203, -152}},
+          {{-123, -72}}, {{-69, -18}}, {{18, 69}}, {{72, 123}}, {{152, 203}}, {{206, 257}}, {{260, 311}},
+          {{314, 365}}, {{394, 445}}, {{448, 499}}}},
+        {{80, SionnaPropagationCache::RU_106_TONE},
+         {{{-499, -394}}, {{-365, -260}}, {{-257, -152}}, {{-123, -18}}, {{18, 123}}, {{152, 257}}, {{260, 365}},
+          {{394, 499}}}},
+        {{80, SionnaPropagationCache::RU_242_TONE}, {{{-500, -259}}, {{-258, -17}}, {{17, 258}}, {{259, 500}}}},
+        {{80, SionnaPropagationCache::RU_484_TONE}, {{{-500, -17}}, {{17, 500}}}},
+        {{80, SionnaPropagationCache::RU_996_TONE}, {{{-500, -3}, {3, 500}}}},
+    };
+
+    static const std::vector<ToneRanges> none;
+    if (width == 160 && tones.find(std::make_pair(width, ruType)) == tones.end())
+    {
+        // two 80 MHz segments at -/+ 512 tones
+        std::vector<ToneRanges>& rus = tones[std::make_pair(width, ruType)];
+        if (ruType == SionnaPropagationCache::RU_2x996_TONE)
+        {
+            rus.push_back({{-1012, -515}, {-509, -12}, {12, 509}, {515, 1012}});
+        }
+        for (int32_t shift : {-512, 512})
+        {
+            auto it = tones.find(std::make_pair(80, ruType));
+            for (size_t i = 0; it != tones.end() && i < it->second.size(); i++)
+            {
+                ToneRanges ranges = it->second[i];
+                for (auto& range : ranges)
+                {
+                    range.first += shift;
+                    range.second += shift;
+                }
+                rus.push_back(ranges);
+            }
+        }
+    }
+    auto it = tones.find(std::make_pair(width, ruType));
+    return it != tones.end() ? it->second : none;
+}
+
+} // namespace
+
 TypeId
 SionnaPropagationCache::GetTypeId()
 {
@@ -30,14 +138,37 @@ SionnaPropagationCache::GetTypeId()
         TypeId("ns3::SionnaPropagationCache")
             .SetParent<Object>()
             .SetGroupName("Propagation")
-            .AddConstructor<SionnaPropagationCache>();
+            .AddConstructor<SionnaPropagationCache>()
+            .AddTraceSource("DeadlineMiss",
+                            "The reply of a request whose lookup missed the deadline arrived.",
+                            MakeTraceSourceAccessor(&SionnaPropagationCache::m_deadlineMissTrace),
+                            "ns3::SionnaPropagationCache::DeadlineMissTracedCallback");
     return tid;
 }
 
 SionnaPropagationCache::SionnaPropagationCache()
-    : m_sionnaHelper(nullptr), m_caching(true), m_cache_hits(0), m_cache_miss(0), m_optimize(true)
+    : m_sionnaHelper(nullptr), m_caching(true), m_cache_hits(0), m_cache_miss(0), m_optimize(true),
+      m_tier_rt_margin(0), m_tier_mw_margin(0), m_tier_ld_margin(0), m_tier_hysteresis(0), m_tier_lookups{},
+      m_tier_models_configured(false), m_geometry_lookups(0), m_geometry_pruned(0), m_geometry_walls(0), m_geometry_pruned_walls(0), m_timing_links(0), m_timing_calls(0), m_adaptive_ttl(false), m_ttl_max_loss_delta(1.0),
+      m_ttl_min_csi_corr(0.9), m_ttl_max_scale(8.0), m_ttl_comparisons(0), m_ttl_stable(0),
+      m_ttl_requests_saved(0), m_im_validation_interval(0), m_im_links(0), m_im_samples(0), m_im_validated(0),
+      m_im_loss_error_sum(0), m_im_loss_error_max(0), m_im_delay_error_sum(0), m_im_csi_compared(0),
+      m_im_csi_corr_sum(0), m_sparse_p2mp(false), m_sparse_requests(0), m_sparse_rx(0), m_sparse_rx_all(0),
+      m_traffic_aware(false), m_data_window(Seconds(1)), m_hint_tx_node(0), m_hint_data(false),
+      m_hint_time(Time::Min()), m_traffic_lookups(0), m_traffic_requests_avoided(0),
+      m_rt_accuracy(ns3sionna::ChannelStateRequest::ACCURACY_FIXED), m_rt_links(0), m_rt_num_samples_sum(0),
+      m_rt_max_depth_sum(0), m_rt_diffraction_links(0), m_path_update_interval(Time(0)), m_path_windows(0),
+      m_path_sum(0), m_path_syntheses(0), m_ru_cache(false), m_ru_layout_bw(0), m_ru_layout_fft_size(0),
+      m_ru_offset{}, m_ru_count{}, m_ru_windows(0), m_band_lookups(0), m_band_scaled(0),
+      m_warm_start_links(0), m_warm_start_time(0), m_offline(false),
+      m_prefetch_requests(0), m_prefetch_skipped(0), m_prefetch_waits(0), m_prefetch_late_hits(0),
+      m_prefetch_wait_time(0), m_deadline(Time(0)), m_fallback_entry(Time(0), 0, Time(0), Time(0)),
+      m_deadline_misses(0), m_deadline_last_window(0), m_deadline_late_replies(0), m_deadline_late_time(0),
+      m_deadline_late_max(0)
 {
     m_friisLossModel = CreateObject<FriisPropagationLossModel>();
+    m_logDistanceLossModel = CreateObject<LogDistancePropagationLossModel>();
+    m_logDistanceLossModel->SetPathLossExponent(3.0);
     m_constSpeedDelayModel = CreateObject<ConstantSpeedPropagationDelayModel>();
 }
 
@@ -49,12 +180,29 @@ SionnaPropagationCache::~SionnaPropagationCache()
 Time
 SionnaPropagationCache::GetPropagationDelay(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
 {
+    // Check if the frame does not justify a ray tracing request
+    if (IsLowPriorityLink(a, b) &&
+        !FindEntry(CacheKey(a->GetObject<Node>()->GetId(), b->GetObject<Node>()->GetId()), Simulator::Now()))
+    {
+        return m_constSpeedDelayModel->GetDelay(a, b);
+    }
+
     // Check if distance is too far so that a simpler model can be used
     if (m_optimize)
     {
-        const double MAX_TXPOWER_DBM = 20.0; // AZU: todo: hardcoded
-        double resultdBm = m_friisLossModel->CalcRxPower(MAX_TXPOWER_DBM, a, b);
-        if (resultdBm + m_optimize_margin < m_sionnaHelper->GetNoiseFloor())
+        // the tier of the link is set with the loss; the TX power is not known here
+        FidelityTier tier;
+        auto it = m_link_tier.find(CacheKey(a->GetObject<Node>()->GetId(), b->GetObject<Node>()->GetId()));
+        if (it != m_link_tier.end())
+        {
+            tier = it->second;
+        }
+        else
+        {
+            tier = SelectTier(a, b, MAX_TXPOWER_DBM);
+        }
+
+        if (tier != TIER_RAYTRACING)
         {
             Time const_delay = m_constSpeedDelayModel->GetDelay(a, b);
             NS_LOG_INFO("Skipped raytracing for prop delay due to large distance; const delay used: " << const_delay);
@@ -67,49 +215,1020 @@ SionnaPropagationCache::GetPropagationDelay(Ptr<MobilityModel> a, Ptr<MobilityMo
 }
 
 double
-SionnaPropagationCache::GetPropagationLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b, double txPowerDbm) const
+SionnaPropagationCache::GetPropagationLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b, double txPowerDbm,
+                                           uint32_t band) const
 {
+    NS_ASSERT_MSG(band < m_sionnaHelper->GetNBands(), "Band " << band << " is not configured.");
+    if (band > 0)
+    {
+        m_band_lookups += 1;
+    }
+
     // Check if distance is too far so that a simpler model can be used
-    if (m_optimize)
+    double walls_loss = 0;
+    bool pruned = false;
+    uint32_t walls = 0;
+    FidelityTier tier = m_optimize ? SelectTier(a, b, txPowerDbm, &walls_loss, &pruned, &walls) : TIER_RAYTRACING;
+
+    // Check if the frame does not justify a ray tracing request; a window in the cache is used anyway
+    if (tier == TIER_RAYTRACING && IsLowPriorityLink(a, b))
+    {
+        m_traffic_lookups += 1;
+        if (!FindEntry(CacheKey(a->GetObject<Node>()->GetId(), b->GetObject<Node>()->GetId()), Simulator::Now()))
+        {
+            ConfigureTierModels();
+            m_traffic_requests_avoided += 1;
+            if (m_geometry)
+            {
+                walls_loss = m_geometry->GetPenetrationLoss(a->GetPosition(), b->GetPosition(),
+                                                            m_sionnaHelper->GetFrequency());
+                tier = TIER_MULTI_WALL;
+            }
+            else
+            {
+                tier = TIER_LOG_DISTANCE;
+            }
+        }
+    }
+    m_tier_lookups[tier] += 1;
+    if (m_optimize && m_geometry)
+    {
+        m_geometry_lookups += 1;
+        m_geometry_pruned += pruned ? 1 : 0;
+        m_geometry_walls += walls;
+        m_geometry_pruned_walls += pruned ? walls : 0;
+    }
+
+    if (tier == TIER_FRIIS)
+    {
+        double friis_loss = txPowerDbm - m_friisLossModel->CalcRxPower(txPowerDbm, a, b);
+        NS_LOG_INFO("Skipped raytracing for prop loss due to large distance; friis loss used: " << friis_loss);
+        return friis_loss + GetBandLossOffset(band);
+    }
+    else if (tier == TIER_MULTI_WALL)
+    {
+        double mw_loss = txPowerDbm - m_friisLossModel->CalcRxPower(txPowerDbm, a, b) + walls_loss;
+        NS_LOG_INFO("Skipped raytracing for prop loss due to walls; multi-wall loss used: " << mw_loss);
+        return mw_loss + GetBandLossOffset(band);
+    }
+    else if (tier == TIER_LOG_DISTANCE)
+    {
+        double ld_loss = txPowerDbm - m_logDistanceLossModel->CalcRxPower(txPowerDbm, a, b);
+        NS_LOG_INFO("Skipped raytracing for prop loss due to SNR margin; log-distance loss used: " << ld_loss);
+        return ld_loss + GetBandLossOffset(band);
+    }
+    // signal is too strong and need to be computed with ray tracing
+    return GetBandLoss(GetPropagationData(a, b), band);
+}
+
+double
+SionnaPropagationCache::GetBandLoss(const CacheEntry& entry, uint32_t band) const
+{
+    if (band == 0)
+    {
+        return entry.m_loss;
+    }
+    if (band <= entry.m_band_loss.size())
+    {
+        return entry.m_band_loss[band - 1];
+    }
+    // e.g. loss and delay only, path response or image method: the gain of each path scales with the wavelength
+    m_band_scaled += 1;
+    return entry.m_loss + GetBandLossOffset(band);
+}
+
+double
+SionnaPropagationCache::GetBandLossOffset(uint32_t band) const
+{
+    if (band == 0)
+    {
+        return 0;
+    }
+    return 20 * std::log10(m_sionnaHelper->GetBandFrequency(band) / m_sionnaHelper->GetFrequency());
+}
+
+const std::vector<std::complex<double>>&
+SionnaPropagationCache::GetChannelState(Ptr<MobilityModel> a, Ptr<MobilityModel> b, Time& startTime,
+                                        Time& endTime, uint32_t band) const
+{
+    static const std::vector<std::complex<double>> no_csi;
+    startTime = Simulator::Now();
+    endTime = Simulator::Now();
+
+    const CacheEntry* entry = GetRayTracedEntry(a, b);
+    if (!entry)
+    {
+        return no_csi;
+    }
+    // with the path response the CSI changes within the window at each synthesis
+    startTime = entry->m_path_delay.empty() ? entry->m_start_time : entry->m_synth_time;
+    endTime = entry->m_end_time;
+    if (band > 0)
+    {
+        return band <= entry->m_band_csi.size() ? entry->m_band_csi[band - 1] : no_csi;
+    }
+    return entry->m_csi;
+}
+
+double
+SionnaPropagationCache::GetRuLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b, uint16_t width, RuType ruType,
+                                  uint32_t ruIndex) const
+{
+    NS_ASSERT_MSG(m_ru_cache, "The RU cache is not enabled.");
+    ConfigureRuLayout();
+    int w = width == 20 ? 0 : width == 40 ? 1 : width == 80 ? 2 : width == 160 ? 3 : -1;
+    NS_ASSERT_MSG(w >= 0 && ruType < NUM_RU_TYPES && ruIndex < m_ru_count[w][ruType],
+                  "RU " << ruIndex << " of type " << ruType << " is not within the Sionna bandwidth.");
+
+    const CacheEntry* entry = GetRayTracedEntry(a, b);
+    if (!entry || entry->m_ru_loss.empty())
+    {
+        // no CSI: flat
+        return GetPropagationLoss(a, b, MAX_TXPOWER_DBM);
+    }
+    return entry->m_ru_loss[m_ru_offset[w][ruType] + ruIndex];
+}
+
+uint32_t
+SionnaPropagationCache::GetNRus(uint16_t width, RuType ruType) const
+{
+    ConfigureRuLayout();
+    int w = width == 20 ? 0 : width == 40 ? 1 : width == 80 ? 2 : width == 160 ? 3 : -1;
+    return (w >= 0 && ruType < NUM_RU_TYPES) ? m_ru_count[w][ruType] : 0;
+}
+
+const SionnaPropagationCache::CacheEntry*
+SionnaPropagationCache::GetRayTracedEntry(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+    // same decision as for the delay; the tier of the link is set with the loss
+    bool raytracing = true;
+    if (IsLowPriorityLink(a, b) &&
+        !FindEntry(CacheKey(a->GetObject<Node>()->GetId(), b->GetObject<Node>()->GetId()), Simulator::Now()))
+    {
+        raytracing = false;
+    }
+    else if (m_optimize)
+    {
+        auto it = m_link_tier.find(CacheKey(a->GetObject<Node>()->GetId(), b->GetObject<Node>()->GetId()));
+        FidelityTier tier = it != m_link_tier.end() ? it->second : SelectTier(a, b, MAX_TXPOWER_DBM);
+        raytracing = tier == TIER_RAYTRACING;
+    }
+    if (!raytracing)
+    {
+        return nullptr;
+    }
+    return &GetPropagationData(a, b);
+}
+
+SionnaHelper*
+SionnaPropagationCache::GetSionnaHelper() const
+{
+    return m_sionnaHelper;
+}
+
+SionnaPropagationCache::FidelityTier
+SionnaPropagationCache::SelectTier(Ptr<MobilityModel> a, Ptr<MobilityModel> b, double txPowerDbm,
+                                   double* wallsLoss, bool* pruned, uint32_t* walls) const
+{
+    ConfigureTierModels();
+
+    double friis_margin = m_friisLossModel->CalcRxPower(txPowerDbm, a, b) - m_sionnaHelper->GetNoiseFloor();
+    double margin = friis_margin;
+    uint32_t id_a = a->GetObject<Node>()->GetId();
+    CacheKey key = CacheKey(id_a, b->GetObject<Node>()->GetId());
+    if (m_geometry)
+    {
+        // the walls only change with the positions, i.e. never for static links; no BVH query per lookup
+        Vector first_position = id_a == key.m_first ? a->GetPosition() : b->GetPosition();
+        Vector second_position = id_a == key.m_first ? b->GetPosition() : a->GetPosition();
+        auto walls_it = m_link_walls.find(key);
+        if (walls_it == m_link_walls.end() || walls_it->second.m_first_position != first_position ||
+            walls_it->second.m_second_position != second_position)
+        {
+            LinkWalls link_walls;
+            link_walls.m_first_position = first_position;
+            link_walls.m_second_position = second_position;
+            link_walls.m_walls = 0;
+            link_walls.m_loss = m_geometry->GetPenetrationLoss(first_position, second_position,
+                                                               m_sionnaHelper->GetFrequency(), &link_walls.m_walls);
+            walls_it = m_link_walls.insert_or_assign(key, link_walls).first;
+        }
+        margin -= walls_it->second.m_loss;
+        if (wallsLoss)
+        {
+            *wallsLoss = walls_it->second.m_loss;
+        }
+        if (walls)
+        {
+            *walls = walls_it->second.m_walls;
+        }
+    }
+
+    auto it = m_link_tier.find(key);
+    if (it == m_link_tier.end())
+    {
+        FidelityTier tier = GetTierForMargin(margin);
+        if (pruned)
+        {
+            *pruned = tier != TIER_RAYTRACING && GetTierForMargin(friis_margin) == TIER_RAYTRACING;
+        }
+        m_link_tier.insert(std::make_pair(key, tier));
+        return tier;
+    }
+
+    // hysteresis: a link only moves to a tier it would also get with a margin worse/better by the hysteresis
+    FidelityTier tier = it->second;
+    FidelityTier tier_up = GetTierForMargin(margin - m_tier_hysteresis);
+    FidelityTier tier_down = GetTierForMargin(margin + m_tier_hysteresis);
+    if (tier_up < tier)
+    {
+        tier = tier_up;
+    }
+    else if (tier_down > tier)
+    {
+        tier = tier_down;
+    }
+
+    if (tier != it->second)
+    {
+        NS_LOG_INFO("Fidelity tier:: " << key.m_first << " <-> " << key.m_second << " " << it->second << " -> "
+                    << tier << " (margin: " << margin << " dB)");
+        it->second = tier;
+    }
+    if (pruned)
+    {
+        *pruned = tier != TIER_RAYTRACING && GetTierForMargin(friis_margin) == TIER_RAYTRACING;
+    }
+    return tier;
+}
+
+SionnaPropagationCache::FidelityTier
+SionnaPropagationCache::GetTierForMargin(double margin) const
+{
+    if (margin >= m_tier_rt_margin)
+    {
+        return TIER_RAYTRACING;
+    }
+    else if (m_geometry && margin >= m_tier_mw_margin)
+    {
+        return TIER_MULTI_WALL;
+    }
+    else if (margin >= m_tier_ld_margin)
+    {
+        return TIER_LOG_DISTANCE;
+    }
+    return TIER_FRIIS;
+}
+
+void
+SionnaPropagationCache::ConfigureTierModels() const
+{
+    if (m_tier_models_configured)
+    {
+        return;
+    }
+    NS_ASSERT_MSG(m_sionnaHelper, "SionnaPropagationCache must have reference to SionnaHelper.");
+
+    // the helper is configured after the cache was created; the models use the same frequency as Sionna
+    double frequency = m_sionnaHelper->GetFrequency();
+    m_friisLossModel->SetFrequency(frequency);
+    // log-distance starts with the free space loss at 1m
+    double lambda = 299792458.0 / frequency;
+    m_logDistanceLossModel->SetReference(1.0, 20 * std::log10(4 * M_PI / lambda));
+    if (m_imageMethod)
+    {
+        m_imageMethod->Configure(frequency, m_sionnaHelper->GetChannelBandwidth(), m_sionnaHelper->GetFFTSize());
+    }
+    m_tier_models_configured = true;
+}
+
+void
+SionnaPropagationCache::SetSionnaHelper(SionnaHelper &sionnaHelper)
+{
+    m_sionnaHelper = &sionnaHelper;
+}
+
+void
+SionnaPropagationCache::SetCaching(bool caching)
+{
+    m_caching = caching;
+}
+
+void
+SionnaPropagationCache::SetOptimize(bool optimize)
+{
+    m_optimize = optimize;
+}
+
+void
+SionnaPropagationCache::SetFidelityTiers(double rayTracingMargin, double logDistanceMargin, double hysteresis)
+{
+    NS_ASSERT_MSG(logDistanceMargin <= rayTracingMargin, "Log-distance tier must be below the ray tracing tier.");
+    m_tier_rt_margin = rayTracingMargin;
+    m_tier_mw_margin = std::min(m_tier_mw_margin, rayTracingMargin);
+    m_tier_ld_margin = logDistanceMargin;
+    m_tier_hysteresis = hysteresis;
+}
+
+void
+SionnaPropagationCache::SetMultiWallTier(Ptr<SionnaSceneGeometry> geometry, double multiWallMargin)
+{
+    NS_ASSERT_MSG(multiWallMargin <= m_tier_rt_margin, "Multi-wall tier must be below the ray tracing tier.");
+    m_geometry = geometry;
+    m_link_walls.clear();
+    m_tier_mw_margin = multiWallMargin;
+}
+
+void
+SionnaPropagationCache::SetLogDistanceExponent(double exponent)
+{
+    m_logDistanceLossModel->SetPathLossExponent(exponent);
+}
+
+void
+SionnaPropagationCache::SetAdaptiveTtl(bool adaptiveTtl)
+{
+    m_adaptive_ttl = adaptiveTtl;
+}
+
+void
+SionnaPropagationCache::SetAdaptiveTtlThresholds(double maxLossDelta, double minCsiCorrelation, double maxTtlScale)
+{
+    NS_ASSERT_MSG(maxTtlScale >= 1.0, "Max. TTL scale must be at least 1.");
+    m_ttl_max_loss_delta = maxLossDelta;
+    m_ttl_min_csi_corr = minCsiCorrelation;
+    m_ttl_max_scale = maxTtlScale;
+}
+
+void
+SionnaPropagationCache::SetImageMethodEngine(Ptr<SionnaImageMethodEngine> engine, uint32_t validationInterval)
+{
+    m_imageMethod = engine;
+    m_im_validation_interval = validationInterval;
+    m_tier_models_configured = false;
+}
+
+void
+SionnaPropagationCache::SetPathUpdateInterval(Time interval)
+{
+    m_path_update_interval = interval;
+}
+
+void
+SionnaPropagationCache::SetRuCache(bool ruCache)
+{
+    m_ru_cache = ruCache;
+}
+
+void
+SionnaPropagationCache::SetSparseP2mp(bool sparseP2mp)
+{
+    m_sparse_p2mp = sparseP2mp;
+}
+
+void
+SionnaPropagationCache::SetRayTracingAccuracy(ns3sionna::ChannelStateRequest::Accuracy accuracy)
+{
+    m_rt_accuracy = accuracy;
+}
+
+void
+SionnaPropagationCache::SetTrafficAware(bool trafficAware, Time dataWindow)
+{
+    m_traffic_aware = trafficAware;
+    m_data_window = dataWindow;
+}
+
+void
+SionnaPropagationCache::NotifyPhyTxBegin(std::string context, Ptr<const Packet> packet, double /* txPowerW */)
+{
+    // context: /NodeList/<id>/DeviceList/...
+    std::string::size_type pos = context.find("/NodeList/");
+    NS_ASSERT_MSG(pos != std::string::npos, "PhyTxBegin must be connected with the node in the context.");
+    uint32_t tx_id = std::stoul(context.substr(pos + 10));
+
+    WifiMacHeader hdr;
+    packet->PeekHeader(hdr);
+
+    // the channel is computed right after this trace for all receivers of the frame
+    m_hint_tx_node = tx_id;
+    m_hint_data = hdr.IsData() && !hdr.GetAddr1().IsGroup();
+    m_hint_time = Simulator::Now();
+
+    if (m_hint_data)
+    {
+        uint32_t rx_id;
+        if (GetNodeId(hdr.GetAddr1(), rx_id))
+        {
+            m_last_data[CacheKey(tx_id, rx_id)] = Simulator::Now();
+        }
+    }
+}
+
+void
+SionnaPropagationCache::SetDeadline(Time deadline)
+{
+    m_deadline = deadline;
+}
+
+void
+SionnaPropagationCache::NotifyMacEnqueue(std::string context, Ptr<const WifiMpdu> mpdu)
+{
+    // context: /NodeList/<id>/DeviceList/...
+    std::string::size_type pos = context.find("/NodeList/");
+    NS_ASSERT_MSG(pos != std::string::npos, "Enqueue must be connected with the node in the context.");
+    uint32_t tx_id = std::stoul(context.substr(pos + 10));
+
+    const WifiMacHeader& hdr = mpdu->GetHeader();
+    uint32_t rx_id;
+    if (hdr.GetAddr1().IsGroup() || !GetNodeId(hdr.GetAddr1(), rx_id) || rx_id == tx_id)
+    {
+        return;
+    }
+    Ptr<MobilityModel> a = NodeList::GetNode(tx_id)->GetObject<MobilityModel>();
+    Ptr<MobilityModel> b = NodeList::GetNode(rx_id)->GetObject<MobilityModel>();
+    if (a && b)
+    {
+        Prefetch(a, b);
+    }
+}
+
+void
+SionnaPropagationCache::ConnectMacQueues()
+{
+    // the queues of a non-QoS MAC (Txop) and of the access categories of a QoS MAC
+    bool connected = false;
+    for (const std::string txop : {"Txop", "VO_Txop", "VI_Txop", "BE_Txop", "BK_Txop"})
+    {
+        connected |= Config::ConnectFailSafe("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Mac/" + txop +
+                                                 "/Queue/Enqueue",
+                                             MakeCallback(&SionnaPropagationCache::NotifyMacEnqueue, this));
+    }
+    NS_ABORT_MSG_IF(!connected, "No Wi-Fi MAC queue found for prefetching.");
+}
+
+void
+SionnaPropagationCache::Prefetch(Ptr<MobilityModel> a, Ptr<MobilityModel> b)
+{
+    NS_ASSERT_MSG(m_sionnaHelper, "SionnaPropagationCache must have reference to SionnaHelper.");
+    Ptr<SionnaMobilityModel> sionna_a = DynamicCast<SionnaMobilityModel>(a);
+    Ptr<SionnaMobilityModel> sionna_b = DynamicCast<SionnaMobilityModel>(b);
+    NS_ASSERT_MSG(sionna_a && sionna_b, "Not using SionnaMobilityModel.");
+    uint32_t tx_id = a->GetObject<Node>()->GetId();
+    uint32_t rx_id = b->GetObject<Node>()->GetId();
+    CacheKey key = CacheKey(tx_id, rx_id);
+
+    PollPrefetch();
+    // same decision as for the delay; static links are computed locally by the image method
+    if (!m_caching || m_offline || FindEntry(key, Simulator::Now()) ||
+        (m_imageMethod && IsStatic(sionna_a) && IsStatic(sionna_b)) ||
+        (m_optimize && SelectTier(a, b, MAX_TXPOWER_DBM) != TIER_RAYTRACING))
+    {
+        m_prefetch_skipped += 1;
+        return;
+    }
+
+    auto link = std::make_pair(tx_id, rx_id);
+    if (m_sionnaHelper->m_reply_pending)
+    {
+        if (std::find(m_prefetch_queue.begin(), m_prefetch_queue.end(), link) == m_prefetch_queue.end() &&
+            !(m_request.m_prefetch && CacheKey(m_request.m_tx_node, m_request.m_rx_node) == key))
+        {
+            m_prefetch_queue.push_back(link);
+        }
+        return;
+    }
+    NS_LOG_INFO("Prefetch " << tx_id << " -> " << rx_id);
+    m_prefetch_requests += 1;
+    SendChannelStateRequest(tx_id, rx_id, Simulator::Now(), true);
+}
+
+void
+SionnaPropagationCache::PollPrefetch() const
+{
+    if (m_sionnaHelper->m_reply_pending && !ReceiveChannelState(false))
+    {
+        return;
+    }
+    // the next queued link still without a window
+    while (!m_sionnaHelper->m_reply_pending && !m_prefetch_queue.empty())
+    {
+        auto link = m_prefetch_queue.front();
+        m_prefetch_queue.pop_front();
+        if (FindEntry(CacheKey(link.first, link.second), Simulator::Now()))
+        {
+            m_prefetch_skipped += 1;
+            continue;
+        }
+        NS_LOG_INFO("Prefetch " << link.first << " -> " << link.second);
+        m_prefetch_requests += 1;
+        SendChannelStateRequest(link.first, link.second, Simulator::Now(), true);
+    }
+}
+
+bool
+SionnaPropagationCache::IsLowPriorityLink(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+    // only the frame currently sent by a is known
+    if (!m_traffic_aware || m_hint_data || m_hint_time != Simulator::Now())
+    {
+        return false;
+    }
+    uint32_t tx_id = a->GetObject<Node>()->GetId();
+    if (tx_id != m_hint_tx_node)
+    {
+        return false;
+    }
+
+    // management, control or broadcast frame: only links with recent unicast data are ray traced
+    auto it = m_last_data.find(CacheKey(tx_id, b->GetObject<Node>()->GetId()));
+    return it == m_last_data.end() || Simulator::Now() - it->second > m_data_window;
+}
+
+bool
+SionnaPropagationCache::GetNodeId(Mac48Address address, uint32_t& nodeId)
+{
+    auto it = m_mac_nodes.find(address);
+    if (it == m_mac_nodes.end())
     {
-        double resultdBm = m_friisLossModel->CalcRxPower(txPowerDbm, a, b);
-        if (resultdBm + m_optimize_margin < m_sionnaHelper->GetNoiseFloor())
+        // devices may have been added since the last lookup
+        m_mac_nodes.clear();
+        for (NodeList::Iterator node_it = NodeList::Begin(); node_it != NodeList::End(); ++node_it)
+        {
+            for (uint32_t i = 0; i < (*node_it)->GetNDevices(); i++)
+            {
+                Address dev_address = (*node_it)->GetDevice(i)->GetAddress();
+                if (Mac48Address::IsMatchingType(dev_address))
+                {
+                    m_mac_nodes[Mac48Address::ConvertFrom(dev_address)] = (*node_it)->GetId();
+                }
+            }
+        }
+        it = m_mac_nodes.find(address);
+        if (it == m_mac_nodes.end())
+        {
+            return false;
+        }
+    }
+    nodeId = it->second;
+    return true;
+}
+
+void
+SionnaPropagationCache::SetLookAheadController(Ptr<SionnaLookAheadController> controller)
+{
+    m_lookAheadController = controller;
+}
+
+double
+SionnaPropagationCache::GetStats()
+{
+    double ratio = m_cache_hits / (m_cache_hits + m_cache_miss);
+    return ratio;
+}
+
+double
+SionnaPropagationCache::GetTtlRequestsSaved() const
+{
+    return m_ttl_requests_saved;
+}
+
+void
+SionnaPropagationCache::PrintStats(std::ostream& os) const
+{
+    static const char* tier_names[NUM_TIERS] = {"ray tracing", "multi-wall", "log-distance", "friis"};
+
+    double lookups = 0;
+    for (int tier = 0; tier < NUM_TIERS; tier++)
+    {
+        lookups += m_tier_lookups[tier];
+    }
+    if (lookups > 0)
+    {
+        os << "Lookups per fidelity tier:";
+        for (int tier = 0; tier < NUM_TIERS; tier++)
+        {
+            os << " " << tier_names[tier] << "=" << m_tier_lookups[tier] << " (" << m_tier_lookups[tier] / lookups
+               << ")";
+        }
+        os << std::endl;
+    }
+    if (m_geometry_lookups > 0)
+    {
+        os << "Scene geometry: " << m_geometry_pruned << " of " << m_geometry_lookups
+           << " lookups pruned from ray tracing (" << m_geometry_pruned / m_geometry_lookups << "), "
+           << m_geometry_walls / m_geometry_lookups << " walls per lookup";
+        if (m_geometry_pruned > 0)
+        {
+            os << ", " << m_geometry_pruned_walls / m_geometry_pruned << " per pruned lookup";
+        }
+        os << std::endl;
+    }
+
+    if (m_adaptive_ttl)
+    {
+        double ratio = m_ttl_comparisons > 0 ? m_ttl_stable / m_ttl_comparisons : 0;
+        os << "Adaptive TTL: " << m_ttl_stable << " of " << m_ttl_comparisons << " windows stable (" << ratio
+           << "), requests saved: " << m_ttl_requests_saved << std::endl;
+    }
+
+    if (m_rt_links > 0)
+    {
+        os << "Ray tracing budget: mean num_samples " << m_rt_num_samples_sum / m_rt_links << ", mean max_depth "
+           << m_rt_max_depth_sum / m_rt_links << ", diffraction " << m_rt_diffraction_links << " of " << m_rt_links
+           << " links" << std::endl;
+    }
+
+    if (m_traffic_aware)
+    {
+        os << "Traffic-aware fidelity: " << m_traffic_lookups << " lookups of frames without data, "
+           << m_traffic_requests_avoided << " ray tracing requests avoided" << std::endl;
+    }
+
+    if (m_sparse_requests > 0)
+    {
+        os << "Sparse P2MP: " << m_sparse_rx / m_sparse_requests << " of " << m_sparse_rx_all / m_sparse_requests
+           << " receivers per request" << std::endl;
+    }
+
+    if (m_imageMethod)
+    {
+        os << "Image method: " << m_im_links << " links computed locally";
+        if (m_im_validated > 0)
+        {
+            os << ", " << m_im_validated << " validated against Sionna: mean |loss error| "
+               << m_im_loss_error_sum / m_im_validated << " dB (max " << m_im_loss_error_max
+               << " dB), mean |delay error| " << m_im_delay_error_sum / m_im_validated << " ns";
+            if (m_im_csi_compared > 0)
+            {
+                os << ", mean CSI correlation " << m_im_csi_corr_sum / m_im_csi_compared;
+            }
+        }
+        os << std::endl;
+    }
+
+    if (m_ru_cache && !m_ru_range_index.empty())
+    {
+        os << "RU cache: effective loss of " << m_ru_range_index.size() - 1 << " RUs derived for " << m_ru_windows
+           << " windows" << std::endl;
+    }
+
+    if (m_path_windows > 0)
+    {
+        os << "Path response: " << m_path_windows << " windows with " << m_path_sum / m_path_windows
+           << " paths on average, " << m_path_syntheses << " channel syntheses" << std::endl;
+    }
+
+    if (m_prefetch_requests > 0)
+    {
+        os << "Prefetch: " << m_prefetch_requests << " requests, " << m_prefetch_skipped << " skipped, "
+           << m_prefetch_waits << " lookups waited for a prefetch (" << m_prefetch_late_hits << " served by it), "
+           << m_prefetch_wait_time << " ms blocked" << std::endl;
+    }
+
+    if (!m_deadline.IsZero())
+    {
+        os << "Deadline: " << m_deadline_misses << " misses (" << m_deadline_last_window << " served by the last "
+           << "window, " << m_deadline_misses - m_deadline_last_window << " by log-distance), "
+           << m_deadline_late_replies << " late replies";
+        if (m_deadline_late_replies > 0)
+        {
+            os << " after " << m_deadline_late_time / m_deadline_late_replies << " ms on average (max. "
+               << m_deadline_late_max << " ms)";
+        }
+        os << std::endl;
+    }
+
+    if (m_warm_start_links > 0 || m_offline)
+    {
+        os << "Warm start: " << m_warm_start_links << " links in " << m_warm_start_time << " ms"
+           << (m_offline ? ", Sionna session closed" : "") << std::endl;
+    }
+
+    if (m_band_lookups > 0)
+    {
+        os << "Bands: " << m_band_lookups << " lookups of further bands, " << m_band_scaled
+           << " scaled from band 0" << std::endl;
+    }
+}
+
+void
+SionnaPropagationCache::SynthesizeChannel(CacheEntry& entry, Time time, bool force) const
+{
+    size_t num_paths = entry.m_path_delay.size();
+    if (num_paths == 0 || (!force && Abs(time - entry.m_synth_time) <= m_path_update_interval))
+    {
+        return;
+    }
+    m_path_syntheses += 1;
+
+    // gain and delay of each path at the given time: phase rotation by the Doppler shift and the matching change
+    // of the path length
+    double dt = (time - entry.m_start_time).GetSeconds();
+    double frequency = m_sionnaHelper->GetFrequency();
+    std::vector<double> gain_real(num_paths);
+    std::vector<double> gain_imag(num_paths);
+    std::vector<double> delay(num_paths);
+    double min_delay = std::numeric_limits<double>::max();
+    double power = 0;
+    for (size_t p = 0; p < num_paths; p++)
+    {
+        double phase = 2 * M_PI * entry.m_path_doppler[p] * dt;
+        double c = std::cos(phase);
+        double s = std::sin(phase);
+        gain_real[p] = entry.m_path_gain_real[p] * c - entry.m_path_gain_imag[p] * s;
+        gain_imag[p] = entry.m_path_gain_real[p] * s + entry.m_path_gain_imag[p] * c;
+        delay[p] = entry.m_path_delay[p] - entry.m_path_doppler[p] / frequency * dt;
+        min_delay = std::min(min_delay, delay[p]);
+        power += gain_real[p] * gain_real[p] + gain_imag[p] * gain_imag[p];
+    }
+    entry.m_delay = NanoSeconds(std::llround(min_delay * 1e9));
+    entry.m_synth_time = time;
+
+    if (m_sionnaHelper->GetLossDelayOnly())
+    {
+        // sum of the path powers as computed by Sionna in this mode
+        entry.m_loss = -10 * std::log10(power);
+        entry.m_csi.clear();
+        return;
+    }
+
+    // CFR H(f) = sum_p a_p exp(-j 2 pi f tau_p) at the subcarriers -fftSize/2 ... fftSize/2-1 (as Sionna);
+    // per path the phasor z_p is rotated by w_p = exp(-j 2 pi spacing tau_p) from one subcarrier to the next, so
+    // that each subcarrier is a sum over the SoA arrays of all paths without trigonometric functions
+    int fft_size = m_sionnaHelper->GetFFTSize();
+    double spacing = m_sionnaHelper->GetChannelBandwidth() / fft_size;
+    double first_freq = -(fft_size / 2) * spacing;
+    std::vector<double> z_real(num_paths);
+    std::vector<double> z_imag(num_paths);
+    std::vector<double> w_real(num_paths);
+    std::vector<double> w_imag(num_paths);
+    for (size_t p = 0; p < num_paths; p++)
+    {
+        double phase = -2 * M_PI * first_freq * delay[p];
+        z_real[p] = gain_real[p] * std::cos(phase) - gain_imag[p] * std::sin(phase);
+        z_imag[p] = gain_real[p] * std::sin(phase) + gain_imag[p] * std::cos(phase);
+        w_real[p] = std::cos(-2 * M_PI * spacing * delay[p]);
+        w_imag[p] = std::sin(-2 * M_PI * spacing * delay[p]);
+    }
+
+    entry.m_csi.resize(fft_size);
+    double csi_power = 0;
+    for (int k = 0; k < fft_size; k++)
+    {
+        double sum_real = 0;
+        double sum_imag = 0;
+        for (size_t p = 0; p < num_paths; p++)
+        {
+            sum_real += z_real[p];
+            sum_imag += z_imag[p];
+            double real = z_real[p] * w_real[p] - z_imag[p] * w_imag[p];
+            z_imag[p] = z_real[p] * w_imag[p] + z_imag[p] * w_real[p];
+            z_real[p] = real;
+        }
+        entry.m_csi[k] = std::complex<double>(sum_real, sum_imag);
+        csi_power += sum_real * sum_real + sum_imag * sum_imag;
+    }
+    // see Parseval's theorem
+    entry.m_loss = -10 * std::log10(csi_power / fft_size);
+    UpdateRuLoss(entry);
+}
+
+void
+SionnaPropagationCache::ConfigureRuLayout() const
+{
+    NS_ASSERT_MSG(m_sionnaHelper, "SionnaPropagationCache must have reference to SionnaHelper.");
+    double channel_bw = m_sionnaHelper->GetChannelBandwidth();
+    int fft_size = m_sionnaHelper->GetFFTSize();
+    if (channel_bw == m_ru_layout_bw && fft_size == m_ru_layout_fft_size)
+    {
+        return;
+    }
+    m_ru_layout_bw = channel_bw;
+    m_ru_layout_fft_size = fft_size;
+
+    // 12.8 HE tones per MHz
+    int32_t bw_mhz = static_cast<int32_t>(std::llround(channel_bw / 1e6));
+    int32_t num_tones = bw_mhz * 64 / 5;
+    static const int32_t widths[4] = {20, 40, 80, 160};
+
+    m_ru_ranges.clear();
+    m_ru_range_index.assign(1, 0);
+    uint32_t num_rus = 0;
+    for (int w = 0; w < 4; w++)
+    {
+        for (int r = 0; r < NUM_RU_TYPES; r++)
+        {
+            m_ru_offset[w][r] = num_rus;
+            m_ru_count[w][r] = 0;
+            if (widths[w] > bw_mhz || bw_mhz % widths[w] != 0)
+            {
+                continue;
+            }
+            // all sub-channels of the width, from the lowest frequency
+            for (int32_t sub = 0; sub < bw_mhz / widths[w]; sub++)
+            {
+                int32_t center = (-bw_mhz / 2 + widths[w] / 2 + sub * widths[w]) * 64 / 5;
+                for (const ToneRanges& ranges : GetRuTones(widths[w], r))
+                {
+                    for (const auto& range : ranges)
+                    {
+                        m_ru_ranges.emplace_back(center + range.first, center + range.second);
+                    }
+                    m_ru_range_index.push_back(m_ru_ranges.size());
+                    m_ru_count[w][r] += 1;
+                }
+            }
+            num_rus += m_ru_count[w][r];
+        }
+    }
+
+    // each HE tone takes the nearest subcarrier of the CSI (as computed by Sionna)
+    double spacing = channel_bw / fft_size;
+    m_ru_tone_csi.resize(num_tones);
+    for (int32_t t = 0; t < num_tones; t++)
+    {
+        int64_t k = std::llround((t - num_tones / 2) * 78125.0 / spacing) + fft_size / 2;
+        m_ru_tone_csi[t] = static_cast<uint32_t>(std::max<int64_t>(0, std::min<int64_t>(k, fft_size - 1)));
+    }
+    NS_LOG_INFO("RU layout: " << num_rus << " RUs on " << num_tones << " tones from " << fft_size << " subcarriers");
+}
+
+void
+SionnaPropagationCache::UpdateRuLoss(CacheEntry& entry) const
+{
+    if (!m_ru_cache || entry.m_csi.empty())
+    {
+        return;
+    }
+    ConfigureRuLayout();
+    if (entry.m_csi.size() != static_cast<size_t>(m_ru_layout_fft_size))
+    {
+        return;
+    }
+
+    // |H|^2 per HE tone and its prefix sums; std::complex is stored as (real, imag)
+    size_t num_tones = m_ru_tone_csi.size();
+    m_ru_prefix_power.resize(num_tones + 1);
+    const double* h = reinterpret_cast<const double*>(entry.m_csi.data());
+    const uint32_t* csi_index = m_ru_tone_csi.data();
+    double* power = m_ru_prefix_power.data() + 1;
+    for (size_t t = 0; t < num_tones; t++)
+    {
+        power[t] = h[2 * csi_index[t]] * h[2 * csi_index[t]] + h[2 * csi_index[t] + 1] * h[2 * csi_index[t] + 1];
+    }
+    m_ru_prefix_power[0] = 0;
+    for (size_t t = 1; t <= num_tones; t++)
+    {
+        m_ru_prefix_power[t] += m_ru_prefix_power[t - 1];
+    }
+
+    // mean |H|^2 of the tones of each RU
+    int32_t half = static_cast<int32_t>(num_tones / 2);
+    size_t num_rus = m_ru_range_index.size() - 1;
+    entry.m_ru_loss.resize(num_rus);
+    for (size_t ru = 0; ru < num_rus; ru++)
+    {
+        double sum = 0;
+        int32_t tones = 0;
+        for (uint32_t i = m_ru_range_index[ru]; i < m_ru_range_index[ru + 1]; i++)
+        {
+            sum += m_ru_prefix_power[m_ru_ranges[i].second + half + 1] - m_ru_prefix_power[m_ru_ranges[i].first + half];
+            tones += m_ru_ranges[i].second - m_ru_ranges[i].first + 1;
+        }
+        entry.m_ru_loss[ru] = sum > 0 ? -10 * std::log10(sum / tones) : std::numeric_limits<double>::infinity();
+    }
+    m_ru_windows += 1;
+}
+
+void
+SionnaPropagationCache::UpdateStability(const CacheKey& key, Time start_time, double loss,
+                                        std::vector<std::complex<double>>& csi) const
+{
+    LinkStability& stability = m_stability[key];
+    if (start_time <= stability.m_last_start_time)
+    {
+        // window already seen, e.g. as part of an earlier look-ahead
+        return;
+    }
+
+    if (stability.m_last_start_time != Time::Min())
+    {
+        m_ttl_comparisons += 1;
+        bool stable = std::abs(loss - stability.m_last_loss) <= m_ttl_max_loss_delta;
+
+        // normalized correlation of the CFR of both windows
+        if (stable && !csi.empty() && csi.size() == stability.m_last_csi.size())
         {
-            double friis_loss = (-1) * (resultdBm - txPowerDbm);
-            NS_LOG_INFO("Skipped raytracing for prop loss due to large distance; friis loss used: " << friis_loss);
-            return friis_loss;
+            stable = GetCsiCorrelation(csi, stability.m_last_csi) >= m_ttl_min_csi_corr;
         }
-        // signal is too strong and need to be computed with ray tracing
+
+        double ttl_scale = stable ? std::min(2 * stability.m_ttl_scale, m_ttl_max_scale) : 1.0;
+        if (stable)
+        {
+            m_ttl_stable += 1;
+        }
+        if (ttl_scale != stability.m_ttl_scale)
+        {
+            NS_LOG_INFO("Adaptive TTL:: " << key.m_first << " <-> " << key.m_second << " scale " << stability.m_ttl_scale
+                        << " -> " << ttl_scale);
+        }
+        stability.m_ttl_scale = ttl_scale;
     }
-    return GetPropagationData(a, b).m_loss;
+
+    stability.m_last_start_time = start_time;
+    stability.m_last_loss = loss;
+    stability.m_last_csi.swap(csi);
 }
 
 void
-SionnaPropagationCache::SetSionnaHelper(SionnaHelper &sionnaHelper)
+SionnaPropagationCache::CountSavedRequests(CacheEntry& entry, Time current_time) const
 {
-    m_sionnaHelper = &sionnaHelper;
+    // only entries stretched by the adaptive TTL
+    if (entry.m_base_end_time >= entry.m_end_time || current_time <= entry.m_base_end_time)
+    {
+        return;
+    }
+    int64_t base_ttl = (entry.m_base_end_time - entry.m_start_time).GetNanoSeconds();
+    if (base_ttl <= 0)
+    {
+        return;
+    }
+
+    // each unscaled window used beyond the original validity would have been a request to Sionna
+    int64_t windows = (current_time - entry.m_base_end_time).GetNanoSeconds() / base_ttl + 1;
+    if (windows > entry.m_saved_windows)
+    {
+        m_ttl_requests_saved += windows - entry.m_saved_windows;
+        entry.m_saved_windows = windows;
+    }
 }
 
 void
-SionnaPropagationCache::SetCaching(bool caching)
+SionnaPropagationCache::AddTiming(const std::string& phase, double duration) const
 {
-    m_caching = caching;
+    TimingStats& stats = m_timing[phase];
+    stats.m_histogram.AddValue(duration);
+    stats.m_sum += duration;
+    stats.m_max = std::max(stats.m_max, duration);
 }
 
 void
-SionnaPropagationCache::SetOptimize(bool optimize)
+SionnaPropagationCache::PrintTimingStats(std::ostream& os) const
 {
-    m_optimize = optimize;
-}
+    // phases in processing order; the round trip is measured by ns-3
+    static const std::vector<std::string> phases = {"placement", "compute_paths", "compute_paths_los", "cir", "ofdm",
+                                                    "response", "serialization", "background", "total", "round trip"};
 
-double
-SionnaPropagationCache::GetStats()
-{
-    double ratio = m_cache_hits / (m_cache_hits + m_cache_miss);
-    return ratio;
+    os << "Sionna timing per call (in ms):" << std::endl;
+    for (const std::string& phase : phases)
+    {
+        auto it = m_timing.find(phase);
+        if (it == m_timing.end())
+        {
+            continue;
+        }
+        const Histogram& hist = it->second.m_histogram;
+
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < hist.GetNBins(); i++)
+        {
+            count += hist.GetBinCount(i);
+        }
+
+        // percentiles with the resolution of the histogram
+        double p50 = 0;
+        double p95 = 0;
+        uint32_t cum = 0;
+        for (uint32_t i = 0; i < hist.GetNBins(); i++)
+        {
+            cum += hist.GetBinCount(i);
+            if (p50 == 0 && cum >= 0.5 * count)
+            {
+                p50 = hist.GetBinEnd(i);
+            }
+            if (cum >= 0.95 * count)
+            {
+                p95 = hist.GetBinEnd(i);
+                break;
+            }
+        }
+
+        os << "  " << std::left << std::setw(18) << phase << std::right
+           << " n=" << count
+           << " mean=" << it->second.m_sum / std::max(count, 1u)
+           << " p50<=" << p50
+           << " p95<=" << p95
+           << " max=" << it->second.m_max << std::endl;
+    }
+
+    if (m_timing_calls > 0)
+    {
+        os << "  links per call: " << m_timing_links / m_timing_calls << std::endl;
+    }
 }
 
-SionnaPropagationCache::CacheEntry
+const SionnaPropagationCache::CacheEntry&
 SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
 {
     NS_ASSERT_MSG(m_sionnaHelper, "SionnaPropagationCache must have reference to SionnaHelper.");
@@ -125,6 +1244,12 @@ SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityMod
 
     NS_LOG_INFO("GetPropagationData:: " << node_a->GetId() << " to " << node_b->GetId());
 
+    // a prefetch may have been answered in the meantime
+    if (m_sionnaHelper->m_reply_pending)
+    {
+        PollPrefetch();
+    }
+
     if (m_caching)
     {
         //NS_LOG_INFO("Check cache");
@@ -139,6 +1264,19 @@ SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityMod
             std::vector<CacheEntry>::iterator vec_it = it->second.begin();
             while (vec_it != it->second.end()) {
                 if (vec_it->m_end_time < current_time) {
+                    if (!m_deadline.IsZero())
+                    {
+                        // kept to serve lookups which miss the deadline
+                        auto last = m_last_entries.find(key);
+                        if (last == m_last_entries.end())
+                        {
+                            m_last_entries.emplace(key, *vec_it);
+                        }
+                        else if (last->second.m_end_time <= vec_it->m_end_time)
+                        {
+                            last->second = *vec_it;
+                        }
+                    }
                     vec_it = it->second.erase(vec_it);
                 } else {
                     ++vec_it;
@@ -146,13 +1284,24 @@ SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityMod
             }
 
             // iterate over all stored entries for that link
-            for (CacheEntry c_entry : it->second) {
+            for (CacheEntry& c_entry : it->second) {
                 //NS_LOG_INFO(" " << c_entry.m_start_time << " " << c_entry.m_end_time << " " << current_time);
                 // If delay and loss exist in the cache, check if the entry is not outdated
                 if (c_entry.m_end_time >= current_time && c_entry.m_start_time <= current_time)
                 {
                     NS_LOG_INFO("Cache HIT CSI:: " << node_a->GetId() << " to " << node_b->GetId());
                     m_cache_hits += 1;
+                    CountSavedRequests(c_entry, current_time);
+                    if (m_lookAheadController)
+                    {
+                        m_lookAheadController->NotifyLookup(node_a->GetId(), true);
+                        if (c_entry.m_prefetched && !c_entry.m_used)
+                        {
+                            m_lookAheadController->NotifyPrefetchUsed(c_entry.m_tx_node);
+                        }
+                    }
+                    c_entry.m_used = true;
+                    SynthesizeChannel(c_entry, current_time);
                     // Return cache entry as the value is still fresh
                     return c_entry;
                 }
@@ -163,28 +1312,339 @@ SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityMod
     NS_LOG_INFO("Cache MISS CSI:: " << node_a->GetId() << " to " << node_b->GetId());
     m_cache_miss += 1;
 
+    if (m_imageMethod && IsStatic(sionna_a) && IsStatic(sionna_b) &&
+        ComputeImageMethod(node_a->GetId(), a->GetPosition(), node_b->GetId(), current_time))
+    {
+        return *FindEntry(CacheKey(node_a->GetId(), node_b->GetId()), current_time);
+    }
+
+    if (!RequestChannelState(node_a->GetId(), node_b->GetId(), current_time))
+    {
+        return GetDeadlineFallback(a, b, current_time);
+    }
+
+    // get result from cache
+    CacheEntry* entry = FindEntry(CacheKey(node_a->GetId(), node_b->GetId()), current_time);
+    if (entry)
+    {
+        SynthesizeChannel(*entry, current_time);
+        return *entry;
+    }
+    // cannot be reached
+    static const CacheEntry dummy_entry = CacheEntry(Time(0), -1, Time(0), Time(0));
+    return dummy_entry;
+}
+
+SionnaPropagationCache::CacheEntry*
+SionnaPropagationCache::FindEntry(const CacheKey& key, Time current_time) const
+{
+    auto cache_it = m_cache.find(key);
+    if (cache_it == m_cache.end())
+    {
+        return nullptr;
+    }
+    // iterate over all stored entries for that link
+    for (CacheEntry& c_entry : cache_it->second)
+    {
+        // If delay and loss exist in the cache, check if the entry is not outdated
+        if (c_entry.m_end_time >= current_time && c_entry.m_start_time <= current_time)
+        {
+            return &c_entry;
+        }
+    }
+    return nullptr;
+}
+
+void
+SionnaPropagationCache::WarmStart(bool offline)
+{
+    NS_ASSERT_MSG(m_sionnaHelper, "SionnaPropagationCache must have reference to SionnaHelper.");
+    NS_ASSERT_MSG(m_caching, "The warm start needs caching.");
+    Time current_time = Simulator::Now();
+
+    std::vector<Ptr<SionnaMobilityModel>> static_nodes;
+    bool all_static = true;
+    for (NodeList::Iterator it = NodeList::Begin(); it != NodeList::End(); ++it)
+    {
+        Ptr<SionnaMobilityModel> mobility = (*it)->GetObject<SionnaMobilityModel>();
+        if (!mobility)
+        {
+            continue;
+        }
+        if (IsStatic(mobility))
+        {
+            static_nodes.push_back(mobility);
+        }
+        else
+        {
+            all_static = false;
+        }
+    }
+    NS_ABORT_MSG_IF(offline && !all_static, "The Sionna session can only be closed if all nodes are static.");
+
+    // static links are served by the image method first; only links without a path are left to Sionna
+    if (m_imageMethod)
+    {
+        for (size_t i = 0; i < static_nodes.size(); i++)
+        {
+            uint32_t tx_id = static_nodes[i]->GetObject<Node>()->GetId();
+            // no requested link, i.e. all entries count as computed in advance like the ones of Sionna below
+            ComputeImageMethod(tx_id, static_nodes[i]->GetPosition(), tx_id, current_time);
+        }
+    }
+    // the validation of the image method may leave a reply pending
+    if (m_sionnaHelper->m_reply_pending)
+    {
+        ReceiveChannelState(true);
+    }
+
+    ns3sionna::Wrapper wrapper;
+    ns3sionna::WarmStartRequest* request = wrapper.mutable_warm_start_request();
+    request->set_time(current_time.GetNanoSeconds());
+    request->set_accuracy(m_rt_accuracy);
+    uint32_t num_links = 0;
+    for (size_t i = 0; i < static_nodes.size(); i++)
+    {
+        uint32_t tx_id = static_nodes[i]->GetObject<Node>()->GetId();
+        ns3sionna::WarmStartRequest::TxLinks* tx_links = nullptr;
+        for (size_t j = i + 1; j < static_nodes.size(); j++)
+        {
+            uint32_t rx_id = static_nodes[j]->GetObject<Node>()->GetId();
+            // out of range for ray tracing even at the max. TX power; all links if offline, as the actual TX power of
+            // the PHYs may exceed the assumed max. and no later request is possible
+            if ((!offline && m_optimize &&
+                 SelectTier(static_nodes[i], static_nodes[j], MAX_TXPOWER_DBM) != TIER_RAYTRACING) ||
+                FindEntry(CacheKey(tx_id, rx_id), current_time))
+            {
+                continue;
+            }
+            if (!tx_links)
+            {
+                tx_links = request->add_links();
+                tx_links->set_tx_node(tx_id);
+            }
+            tx_links->add_rx_nodes(rx_id);
+            num_links += 1;
+        }
+    }
+
+    if (num_links > 0)
+    {
+        std::string serialized_message;
+        wrapper.SerializeToString(&serialized_message);
+
+        auto request_start = std::chrono::steady_clock::now();
+        zmq::message_t zmq_message(serialized_message.data(), serialized_message.size());
+        m_sionnaHelper->m_zmq_socket.send(zmq_message, zmq::send_flags::none);
+
+        zmq::message_t zmq_reply;
+        zmq::recv_result_t result = m_sionnaHelper->m_zmq_socket.recv(zmq_reply, zmq::recv_flags::none);
+        NS_ASSERT_MSG(result, "Failed to receive reply after warm start request message.");
+
+        ns3sionna::Wrapper reply_wrapper;
+        reply_wrapper.ParseFromArray(zmq_reply.data(), zmq_reply.size());
+        NS_ASSERT_MSG(reply_wrapper.has_channel_state_response(),
+                      "Reply after warm start request is not a channel state response.");
+
+        std::chrono::duration<double, std::milli> round_trip = std::chrono::steady_clock::now() - request_start;
+        AddTiming("round trip", round_trip.count());
+        AddServerTiming(reply_wrapper.channel_state_response());
+        AddChannelStates(reply_wrapper.channel_state_response(), nullptr, current_time, true);
+        m_warm_start_links += num_links;
+        m_warm_start_time += round_trip.count();
+    }
+    NS_LOG_INFO("Warm start: " << num_links << " links between " << static_nodes.size() << " static nodes");
+
+    if (offline)
+    {
+        m_sionnaHelper->Destroy();
+        m_offline = true;
+    }
+}
+
+bool
+SionnaPropagationCache::RequestChannelState(uint32_t txId, uint32_t rxId, Time current_time) const
+{
+    NS_ABORT_MSG_IF(m_offline, "Link " << txId << " <-> " << rxId << " is not in the cache, but the Sionna session "
+                    "was closed after the warm start.");
+
+    auto lookup_start = std::chrono::steady_clock::now();
+    // the REQ socket needs the reply of a prefetch or late request first, which may cover the link already
+    if (m_sionnaHelper->m_reply_pending)
+    {
+        bool prefetch = m_request.m_prefetch;
+        m_prefetch_waits += prefetch ? 1 : 0;
+        if (!WaitForReply(lookup_start))
+        {
+            // the link is sent in the background like a prefetch
+            auto link = std::make_pair(txId, rxId);
+            if (std::find(m_prefetch_queue.begin(), m_prefetch_queue.end(), link) == m_prefetch_queue.end())
+            {
+                m_prefetch_queue.push_back(link);
+            }
+            return false;
+        }
+        ReceiveChannelState(true);
+        if (FindEntry(CacheKey(txId, rxId), current_time))
+        {
+            m_prefetch_late_hits += prefetch ? 1 : 0;
+            return true;
+        }
+    }
+    SendChannelStateRequest(txId, rxId, current_time, false);
+    if (!WaitForReply(lookup_start))
+    {
+        m_request.m_late = true;
+        return false;
+    }
+    ReceiveChannelState(true);
+    return true;
+}
+
+bool
+SionnaPropagationCache::WaitForReply(std::chrono::steady_clock::time_point start) const
+{
+    if (m_deadline.IsZero())
+    {
+        return true;
+    }
+    // a late reply already missed a deadline; later lookups only check for it instead of each waiting again
+    auto remaining = std::chrono::milliseconds(0);
+    if (!m_request.m_late)
+    {
+        // the poll has ms granularity; round up so that sub-ms deadlines still wait
+        remaining = std::chrono::ceil<std::chrono::milliseconds>(
+            std::chrono::nanoseconds(m_deadline.GetNanoSeconds()) - (std::chrono::steady_clock::now() - start));
+    }
+    zmq::pollitem_t item = {static_cast<void*>(m_sionnaHelper->m_zmq_socket), 0, ZMQ_POLLIN, 0};
+    return zmq::poll(&item, 1, std::max(remaining, std::chrono::milliseconds(0))) > 0;
+}
+
+const SionnaPropagationCache::CacheEntry&
+SionnaPropagationCache::GetDeadlineFallback(Ptr<MobilityModel> a, Ptr<MobilityModel> b, Time current_time) const
+{
+    m_deadline_misses += 1;
+    CacheKey key = CacheKey(a->GetObject<Node>()->GetId(), b->GetObject<Node>()->GetId());
+    NS_LOG_INFO("Deadline MISS CSI:: " << key.m_first << " <-> " << key.m_second);
+
+    auto it = m_last_entries.find(key);
+    if (it != m_last_entries.end())
+    {
+        // path response: the paths of the last window are evolved to the current time; otherwise it is held
+        m_deadline_last_window += 1;
+        SynthesizeChannel(it->second, current_time);
+        return it->second;
+    }
+
+    // statistical model of the scene without CSI
+    ConfigureTierModels();
+    double loss = MAX_TXPOWER_DBM - m_logDistanceLossModel->CalcRxPower(MAX_TXPOWER_DBM, a, b);
+    m_fallback_entry = CacheEntry(m_constSpeedDelayModel->GetDelay(a, b), loss, current_time, current_time);
+    return m_fallback_entry;
+}
+
+void
+SionnaPropagationCache::SendChannelStateRequest(uint32_t txId, uint32_t rxId, Time current_time, bool prefetch) const
+{
+    NS_ASSERT_MSG(!m_sionnaHelper->m_reply_pending, "The reply of the previous request was not received.");
+
     // Prepare the request message
     ns3sionna::Wrapper wrapper;
 
     // Fill the information message
     ns3sionna::ChannelStateRequest* propagation_request = wrapper.mutable_channel_state_request();
-    propagation_request->set_tx_node(node_a->GetId());
-    propagation_request->set_rx_node(node_b->GetId());
+    propagation_request->set_tx_node(txId);
+    propagation_request->set_rx_node(rxId);
     propagation_request->set_time(current_time.GetNanoSeconds());
+    propagation_request->set_accuracy(m_rt_accuracy);
+    if (m_lookAheadController)
+    {
+        if (!prefetch)
+        {
+            m_lookAheadController->NotifyLookup(txId, false);
+        }
+        propagation_request->set_look_ahead(m_lookAheadController->GetLookAhead(txId));
+    }
+    if (m_sionnaHelper->GetClientMobility())
+    {
+        // the walks of all walking nodes until the horizon, e.g. for the look-ahead of Sionna
+        Time end_time = current_time + m_sionnaHelper->GetTrajectoryHorizon();
+        for (auto node = NodeList::Begin(); node != NodeList::End(); ++node)
+        {
+            Ptr<SionnaMobilityModel> mobility = (*node)->GetObject<SionnaMobilityModel>();
+            if (!mobility || !mobility->IsWalking())
+            {
+                continue;
+            }
+            Time known_until;
+            bool stopped;
+            ns3sionna::ChannelStateRequest::NodeTrajectory* trajectory = propagation_request->add_trajectories();
+            trajectory->set_node((*node)->GetId());
+            for (const auto& waypoint : mobility->GetTrajectory(current_time, end_time, known_until, stopped))
+            {
+                ns3sionna::ChannelStateRequest::NodeTrajectory::Waypoint* wp = trajectory->add_waypoints();
+                wp->set_time(waypoint.m_time.GetNanoSeconds());
+                wp->mutable_position()->set_x(waypoint.m_position.x);
+                wp->mutable_position()->set_y(waypoint.m_position.y);
+                wp->mutable_position()->set_z(waypoint.m_position.z);
+                wp->mutable_velocity()->set_x(waypoint.m_velocity.x);
+                wp->mutable_velocity()->set_y(waypoint.m_velocity.y);
+                wp->mutable_velocity()->set_z(waypoint.m_velocity.z);
+            }
+            trajectory->set_end_time(known_until.GetNanoSeconds());
+            trajectory->set_stopped(stopped);
+        }
+    }
+    if (m_sparse_p2mp)
+    {
+        AddRxNodes(txId, rxId, current_time, propagation_request);
+    }
+    if (m_adaptive_ttl)
+    {
+        auto stability_it = m_stability.find(CacheKey(txId, rxId));
+        if (stability_it != m_stability.end())
+        {
+            propagation_request->set_ttl_scale(stability_it->second.m_ttl_scale);
+        }
+    }
     
     // Serialize the request message
     std::string serialized_message;
     wrapper.SerializeToString(&serialized_message);
 
     // Send the request message
+    m_request.m_tx_node = txId;
+    m_request.m_rx_node = rxId;
+    m_request.m_time = current_time;
+    m_request.m_prefetch = prefetch;
+    m_request.m_late = false;
+    m_request.m_start = std::chrono::steady_clock::now();
     zmq::message_t zmq_message(serialized_message.data(), serialized_message.size());
     m_sionnaHelper->m_zmq_socket.send(zmq_message, zmq::send_flags::none);
+    m_sionnaHelper->m_reply_pending = true;
+}
 
+bool
+SionnaPropagationCache::ReceiveChannelState(bool wait) const
+{
     // Receive the reply message
+    auto wait_start = std::chrono::steady_clock::now();
     zmq::message_t zmq_reply;
-    zmq::recv_result_t result = m_sionnaHelper->m_zmq_socket.recv(zmq_reply, zmq::recv_flags::none);
-    
+    zmq::recv_result_t result =
+        m_sionnaHelper->m_zmq_socket.recv(zmq_reply, wait ? zmq::recv_flags::none : zmq::recv_flags::dontwait);
+    if (!result && !wait)
+    {
+        // not yet computed
+        return false;
+    }
     NS_ASSERT_MSG(result, "Failed to receive reply after propagation request message.");
+    m_sionnaHelper->m_reply_pending = false;
+    auto now = std::chrono::steady_clock::now();
+    if (m_request.m_prefetch)
+    {
+        // the time the simulation was blocked by the prefetch
+        m_prefetch_wait_time += std::chrono::duration<double, std::milli>(now - wait_start).count();
+    }
 
     // Check if the reply message is a propagation response
     ns3sionna::Wrapper reply_wrapper;
@@ -197,7 +1657,62 @@ SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityMod
     const ns3sionna::ChannelStateResponse& csi_response = reply_wrapper.channel_state_response();
 
     NS_LOG_INFO("ZMQ::CSI_RESP #samples: " << csi_response.csi_size());
+
+    AddServerTiming(csi_response);
+    if (m_request.m_prefetch)
+    {
+        // the round trip of a prefetch includes the simulation in between; all its links count as prefetched
+        AddChannelStates(csi_response, nullptr, m_request.m_time, false);
+        return true;
+    }
+
+    std::chrono::duration<double, std::milli> round_trip = now - m_request.m_start;
+    if (m_request.m_late)
+    {
+        // received at the first lookup after its arrival, i.e. an upper bound
+        m_deadline_late_replies += 1;
+        m_deadline_late_time += round_trip.count();
+        m_deadline_late_max = std::max(m_deadline_late_max, round_trip.count());
+        m_deadlineMissTrace(m_request.m_tx_node, m_request.m_rx_node, round_trip.count());
+    }
+    else
+    {
+        AddTiming("round trip", round_trip.count());
+        if (m_lookAheadController)
+        {
+            m_lookAheadController->NotifyLatency(m_request.m_tx_node, round_trip.count());
+        }
+    }
     // result contains also future CSI; fill-up the cache
+    CacheKey key2 = CacheKey(m_request.m_tx_node, m_request.m_rx_node);
+    AddChannelStates(csi_response, &key2, m_request.m_time, false);
+    return true;
+}
+
+void
+SionnaPropagationCache::AddServerTiming(const ns3sionna::ChannelStateResponse& csi_response) const
+{
+    if (csi_response.has_timing())
+    {
+        const ns3sionna::ChannelStateResponse::ServerTiming& timing = csi_response.timing();
+        AddTiming("placement", timing.placement() / 1e6);
+        AddTiming("compute_paths", timing.compute_paths() / 1e6);
+        AddTiming("compute_paths_los", timing.compute_paths_los() / 1e6);
+        AddTiming("cir", timing.cir() / 1e6);
+        AddTiming("ofdm", timing.ofdm() / 1e6);
+        AddTiming("response", timing.response() / 1e6);
+        AddTiming("serialization", timing.serialization() / 1e6);
+        AddTiming("background", timing.background() / 1e6);
+        AddTiming("total", timing.total() / 1e6);
+        m_timing_links += timing.num_links();
+        m_timing_calls += 1;
+    }
+}
+
+void
+SionnaPropagationCache::AddChannelStates(const ns3sionna::ChannelStateResponse& csi_response,
+                                         const CacheKey* requested, Time current_time, bool neverExpire) const
+{
     for (int csi_i=0; csi_i < csi_response.csi_size(); csi_i++) {
         Time start_time = NanoSeconds(csi_response.csi(csi_i).start_time());
         Time end_time = NanoSeconds(csi_response.csi(csi_i).end_time());
@@ -209,7 +1724,16 @@ SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityMod
         for (int rx_i=0; rx_i < csi_response.csi(csi_i).rx_nodes_size(); rx_i++) {
             Time delay = NanoSeconds(csi_response.csi(csi_i).rx_nodes(rx_i).delay());
             double wb_loss = csi_response.csi(csi_i).rx_nodes(rx_i).wb_loss();
-            //Time ttl = NanoSeconds(csi_response.csi(csi_i).rx_nodes(rx_i).ttl());
+            // per link validity, e.g. links between static nodes never expire
+            Time lnk_end_time = end_time;
+            if (csi_response.csi(csi_i).rx_nodes(rx_i).end_time() > 0)
+            {
+                lnk_end_time = NanoSeconds(csi_response.csi(csi_i).rx_nodes(rx_i).end_time());
+            }
+            if (neverExpire)
+            {
+                lnk_end_time = Time::Max();
+            }
 
             google::protobuf::uint32 rxId = csi_response.csi(csi_i).rx_nodes(rx_i).id();
 
@@ -219,25 +1743,68 @@ SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityMod
               << rxId << " [" << csi_response.csi(csi_i).rx_nodes(rx_i).position().x() << "," << csi_response.csi(csi_i).rx_nodes(rx_i).position().y()
               << "," << csi_response.csi(csi_i).rx_nodes(rx_i).position().z() << "])");
 
-            // CSI
-            std::stringstream ss;
-            ss << "[";
-            for (int i=0; i < csi_response.csi(csi_i).rx_nodes(rx_i).csi_imag().size(); i++)
+            // Add the info from all other receivers to the cache
+            CacheKey otherkey = CacheKey(txId, rxId);
+            CacheEntry entry = CacheEntry(delay, wb_loss, start_time, lnk_end_time);
+            const ns3sionna::ChannelStateResponse::ChannelState::RxNodeInfo& rx_info =
+                csi_response.csi(csi_i).rx_nodes(rx_i);
+            if (rx_info.rt_num_samples() > 0)
             {
-                double imag = csi_response.csi(csi_i).rx_nodes(rx_i).csi_imag(i);
-                double real = csi_response.csi(csi_i).rx_nodes(rx_i).csi_real(i);
-                ss << imag << "*1i + " << real;
-
-                if (i < csi_response.csi(csi_i).rx_nodes(rx_i).csi_imag().size() - 1)
-                    ss << ",";
+                NS_LOG_INFO("    -> ray tracing budget (num_samples: " << rx_info.rt_num_samples() << ", max_depth: "
+                            << rx_info.rt_max_depth() << ", diffraction: " << rx_info.rt_diffraction() << ")");
+                m_rt_links += 1;
+                m_rt_num_samples_sum += rx_info.rt_num_samples();
+                m_rt_max_depth_sum += rx_info.rt_max_depth();
+                m_rt_diffraction_links += rx_info.rt_diffraction() ? 1 : 0;
+            }
+            entry.m_csi.resize(std::min(rx_info.csi_real_size(), rx_info.csi_imag_size()));
+            for (size_t i = 0; i < entry.m_csi.size(); i++)
+            {
+                entry.m_csi[i] = std::complex<double>(rx_info.csi_real(i), rx_info.csi_imag(i));
+            }
+            for (const auto& band_state : rx_info.bands())
+            {
+                entry.m_band_loss.push_back(band_state.wb_loss());
+                std::vector<std::complex<double>>& band_csi = entry.m_band_csi.emplace_back();
+                band_csi.resize(std::min(band_state.csi_real_size(), band_state.csi_imag_size()));
+                for (size_t i = 0; i < band_csi.size(); i++)
+                {
+                    band_csi[i] = std::complex<double>(band_state.csi_real(i), band_state.csi_imag(i));
+                }
+            }
+            if (rx_info.path_delay_size() > 0)
+            {
+                entry.m_path_gain_real.assign(rx_info.path_gain_real().begin(), rx_info.path_gain_real().end());
+                entry.m_path_gain_imag.assign(rx_info.path_gain_imag().begin(), rx_info.path_gain_imag().end());
+                entry.m_path_delay.assign(rx_info.path_delay().begin(), rx_info.path_delay().end());
+                entry.m_path_doppler.assign(rx_info.path_doppler().begin(), rx_info.path_doppler().end());
+                m_path_windows += 1;
+                m_path_sum += entry.m_path_delay.size();
+                // the channel at the start of the window
+                SynthesizeChannel(entry, start_time, true);
+            }
+            else
+            {
+                UpdateRuLoss(entry);
+            }
+            if (csi_response.csi(csi_i).rx_nodes(rx_i).base_end_time() > 0)
+            {
+                entry.m_base_end_time = NanoSeconds(csi_response.csi(csi_i).rx_nodes(rx_i).base_end_time());
+            }
+            entry.m_tx_node = txId;
+            entry.m_prefetched = !(requested && otherkey.m_first == requested->m_first &&
+                                   otherkey.m_second == requested->m_second && start_time <= current_time &&
+                                   current_time <= lnk_end_time);
+            if (entry.m_prefetched && m_lookAheadController)
+            {
+                m_lookAheadController->NotifyPrefetched(txId, 1);
             }
-            ss << "]" << std::endl;
-            //NS_LOG_INFO("    -> CSI " << " (TxId: " << txId << " -> " << rxId << ")" << ss.str());
 
-            // Add the info from all other receivers to the cache
-            CacheKey otherkey = CacheKey(txId, rxId);
-            // AZU: todo: add CSI to cache
-            CacheEntry entry = CacheEntry(delay, wb_loss, start_time, end_time);
+            if (m_adaptive_ttl)
+            {
+                std::vector<std::complex<double>> lnk_csi = entry.m_csi;
+                UpdateStability(otherkey, start_time, wb_loss, lnk_csi);
+            }
 
             auto cache_it = m_cache.find(otherkey);
 
@@ -252,25 +1819,149 @@ SionnaPropagationCache::GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityMod
             }
         }
     }
+}
 
-    // get result from cache
-    CacheKey key2 = CacheKey(node_a->GetId(), node_b->GetId());
-    auto cache_it = m_cache.find(key2);
-    if (cache_it != m_cache.end())
-    {
-        // iterate over all stored entries for that link
-        for (CacheEntry c_entry : cache_it->second) {
-            // If delay and loss exist in the cache, check if the entry is not outdated
-            if (c_entry.m_end_time >= current_time && c_entry.m_start_time <= current_time)
+void
+SionnaPropagationCache::AddRxNodes(uint32_t txId, uint32_t rxId, Time current_time,
+                                   ns3sionna::ChannelStateRequest* request) const
+{
+    Ptr<Node> tx_node = NodeList::GetNode(txId);
+    Ptr<MobilityModel> tx_mobility = tx_node->GetObject<MobilityModel>();
+
+    request->add_rx_nodes(rxId);
+    uint32_t num_rx = 1;
+    uint32_t num_all = 0;
+    for (NodeList::Iterator it = NodeList::Begin(); it != NodeList::End(); ++it)
+    {
+        uint32_t id = (*it)->GetId();
+        Ptr<MobilityModel> mobility = (*it)->GetObject<SionnaMobilityModel>();
+        if (id == txId || !mobility)
+        {
+            continue;
+        }
+        num_all += 1;
+        if (id == rxId)
+        {
+            continue;
+        }
+
+        // a valid window is known already
+        CacheKey key = CacheKey(txId, id);
+        if (FindEntry(key, current_time))
+        {
+            continue;
+        }
+        // out of range for ray tracing: the current tier of the link or, if not used so far, the tier based on
+        // Friis, i.e. the best case without walls
+        if (m_optimize)
+        {
+            auto tier_it = m_link_tier.find(key);
+            FidelityTier tier = TIER_RAYTRACING;
+            if (tier_it != m_link_tier.end())
+            {
+                tier = tier_it->second;
+            }
+            else
+            {
+                ConfigureTierModels();
+                double margin = m_friisLossModel->CalcRxPower(MAX_TXPOWER_DBM, tx_mobility, mobility) -
+                                m_sionnaHelper->GetNoiseFloor();
+                tier = GetTierForMargin(margin + m_tier_hysteresis);
+            }
+            if (tier != TIER_RAYTRACING)
             {
-                // Return cache entry as the value is still fresh
-                return c_entry;
+                continue;
             }
         }
+        request->add_rx_nodes(id);
+        num_rx += 1;
     }
-    // cannot be reached
-    CacheEntry dummy_entry = CacheEntry(current_time, -1, current_time, current_time);
-    return dummy_entry;
+
+    NS_LOG_INFO("Sparse P2MP:: TX " << txId << " " << num_rx << " of " << num_all << " receivers");
+    m_sparse_requests += 1;
+    m_sparse_rx += num_rx;
+    m_sparse_rx_all += num_all;
+}
+
+bool
+SionnaPropagationCache::ComputeImageMethod(uint32_t txId, const Vector& txPos, uint32_t rxId,
+                                           Time current_time) const
+{
+    ConfigureTierModels();
+
+    // like P2MP in Sionna, all static links of the TX not yet known are computed at once (in parallel)
+    std::vector<uint32_t> rx_ids;
+    std::vector<std::pair<Vector, Vector>> links;
+    for (NodeList::Iterator it = NodeList::Begin(); it != NodeList::End(); ++it)
+    {
+        uint32_t id = (*it)->GetId();
+        Ptr<SionnaMobilityModel> mobility = (*it)->GetObject<SionnaMobilityModel>();
+        if (id == txId || !mobility || !IsStatic(mobility) ||
+            (id != rxId && FindEntry(CacheKey(txId, id), current_time)))
+        {
+            continue;
+        }
+        rx_ids.push_back(id);
+        links.emplace_back(txPos, mobility->GetPosition());
+    }
+
+    std::vector<SionnaImageMethodEngine::Result> results = m_imageMethod->ComputeLinks(links);
+
+    bool found = false;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const SionnaImageMethodEngine::Result& result = results[i];
+        CacheKey key = CacheKey(txId, rx_ids[i]);
+        if (FindEntry(key, current_time))
+        {
+            // added by the validation of another link, i.e. in modes 2/3 Sionna computes all receivers of the TX
+            found = found || rx_ids[i] == rxId;
+            continue;
+        }
+        if (result.m_num_paths == 0)
+        {
+            // no LOS or reflection; left to Sionna, e.g. for diffraction
+            continue;
+        }
+        found = found || rx_ids[i] == rxId;
+        m_im_samples += 1;
+
+        if (m_im_validation_interval > 0 && static_cast<uint64_t>(m_im_samples) % m_im_validation_interval == 0)
+        {
+            // sampled link: compare against Sionna and keep the result of Sionna
+            RequestChannelState(txId, rx_ids[i], current_time);
+            const CacheEntry* sionna_entry = FindEntry(key, current_time);
+            if (sionna_entry)
+            {
+                double loss_error = std::abs(result.m_loss - sionna_entry->m_loss);
+                m_im_validated += 1;
+                m_im_loss_error_sum += loss_error;
+                m_im_loss_error_max = std::max(m_im_loss_error_max, loss_error);
+                m_im_delay_error_sum += std::abs((result.m_delay - sionna_entry->m_delay).GetNanoSeconds());
+                if (result.m_csi.size() == sionna_entry->m_csi.size())
+                {
+                    m_im_csi_compared += 1;
+                    m_im_csi_corr_sum += GetCsiCorrelation(result.m_csi, sionna_entry->m_csi);
+                }
+                NS_LOG_INFO("ImageMethod:: validation " << txId << " -> " << rx_ids[i] << " loss " << result.m_loss
+                            << " vs. " << sionna_entry->m_loss << " dB, delay " << result.m_delay << " vs. "
+                            << sionna_entry->m_delay);
+                continue;
+            }
+        }
+
+        NS_LOG_INFO("ImageMethod:: " << txId << " -> " << rx_ids[i] << " (delay: " << result.m_delay
+                    << ", loss: " << result.m_loss << ", paths: " << result.m_num_paths << ")");
+        // static links never expire
+        CacheEntry entry = CacheEntry(result.m_delay, result.m_loss, current_time, Time::Max());
+        entry.m_csi = result.m_csi;
+        UpdateRuLoss(entry);
+        entry.m_tx_node = txId;
+        entry.m_prefetched = rx_ids[i] != rxId;
+        m_cache[key].push_back(entry);
+        m_im_links += 1;
+    }
+    return found;
 }
 
 } // namespace ns3
@@ -9,13 +9,24 @@
 #ifndef SIONNA_PROPAGATION_CACHE_H
 #define SIONNA_PROPAGATION_CACHE_H
  
+#include "ns3/histogram.h"
+#include "ns3/mac48-address.h"
 #include "ns3/mobility-model.h"
 #include "ns3/nstime.h"
 #include "ns3/object.h"
+#include "ns3/packet.h"
 #include "ns3/ptr.h"
+#include "ns3/traced-callback.h"
+#include "ns3/wifi-mpdu.h"
 
 #include "sionna-helper.h"
+#include "sionna-image-method.h"
+#include "sionna-lookahead-controller.h"
+#include "sionna-scene-geometry.h"
 
+#include <chrono>
+#include <complex>
+#include <deque>
 #include <map>
 
 #include <ns3/propagation-delay-model.h>
@@ -33,15 +44,104 @@ class SionnaPropagationCache : public ns3::Object
     public:
         static TypeId GetTypeId();
 
+        // channel models used per link, from highest to lowest fidelity
+        enum FidelityTier
+        {
+            TIER_RAYTRACING,
+            TIER_MULTI_WALL,
+            TIER_LOG_DISTANCE,
+            TIER_FRIIS,
+            NUM_TIERS
+        };
+
+        // 802.11ax resource units (same order as HeRu::RuType)
+        enum RuType
+        {
+            RU_26_TONE,
+            RU_52_TONE,
+            RU_106_TONE,
+            RU_242_TONE,
+            RU_484_TONE,
+            RU_996_TONE,
+            RU_2x996_TONE,
+            NUM_RU_TYPES
+        };
+
         SionnaPropagationCache();
         ~SionnaPropagationCache();
 
         Time GetPropagationDelay(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
-        double GetPropagationLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b, double txPowerDbm) const;
+        // loss in the given band of the SionnaHelper; the bands share the paths, the tier and the window of the link
+        double GetPropagationLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b, double txPowerDbm,
+                                  uint32_t band = 0) const;
+        // CSI of the link at the current time and the window it belongs to; empty if the link is not ray traced
+        const std::vector<std::complex<double>>& GetChannelState(Ptr<MobilityModel> a, Ptr<MobilityModel> b,
+                                                                 Time& startTime, Time& endTime,
+                                                                 uint32_t band = 0) const;
+        SionnaHelper* GetSionnaHelper() const;
+        // effective loss (in dB) of an RU of an HE PPDU of the given width (20/40/80/160 MHz) at the current time,
+        // i.e. from the mean |H|^2 of its tones; the RUs of all sub-channels of that width within the Sionna
+        // bandwidth are numbered from the lowest frequency. Needs SetRuCache; the wideband loss without CSI.
+        double GetRuLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b, uint16_t width, RuType ruType,
+                         uint32_t ruIndex) const;
+        // no. of RUs of the type for the width within the Sionna bandwidth
+        uint32_t GetNRus(uint16_t width, RuType ruType) const;
         void SetSionnaHelper(SionnaHelper &sionnaHelper);
         void SetCaching(bool caching);
         void SetOptimize(bool optimize);
+        void SetFidelityTiers(double rayTracingMargin, double logDistanceMargin, double hysteresis);
+        void SetLogDistanceExponent(double exponent);
+        void SetMultiWallTier(Ptr<SionnaSceneGeometry> geometry, double multiWallMargin);
+        void SetAdaptiveTtl(bool adaptiveTtl);
+        void SetAdaptiveTtlThresholds(double maxLossDelta, double minCsiCorrelation, double maxTtlScale);
+        void SetLookAheadController(Ptr<SionnaLookAheadController> controller);
+        // class of the ray tracing budget chosen by Sionna per link (ACCURACY_FIXED: the fixed budget of the server)
+        void SetRayTracingAccuracy(ns3sionna::ChannelStateRequest::Accuracy accuracy);
+        // frames other than unicast data are served without ray tracing, unless the link carried unicast data
+        // within the data window; needs NotifyPhyTxBegin
+        void SetTrafficAware(bool trafficAware, Time dataWindow);
+        // to be connected to the PhyTxBegin trace of all WifiPhys with Config::Connect, i.e. with context
+        void NotifyPhyTxBegin(std::string context, Ptr<const Packet> packet, double txPowerW);
+        // node with a device of the given MAC address; false if unknown
+        bool GetNodeId(Mac48Address address, uint32_t& nodeId);
+        // modes 2/3: only receivers without a valid window and in range for ray tracing are requested
+        void SetSparseP2mp(bool sparseP2mp);
+        // static links are computed by the native image method; every n-th of them is compared against Sionna (0: never)
+        void SetImageMethodEngine(Ptr<SionnaImageMethodEngine> engine, uint32_t validationInterval);
+        // path response: the channel of a window is synthesized again if the time moved by more than this interval
+        void SetPathUpdateInterval(Time interval);
+        // the effective loss of all RUs is derived from the CSI of each window when it is added
+        void SetRuCache(bool ruCache);
+        // all links between static nodes which are ray traced (see SetOptimize) are requested in a single call and
+        // never expire; with an image method engine, only the links without a path are requested; if offline, all
+        // links are requested and the Sionna session is closed afterwards, which needs all nodes to be static
+        void WarmStart(bool offline);
+        // requests the channel of the link for the current time without waiting for Sionna, i.e. the reply is
+        // received at a later lookup; links with a valid window or not ray traced are skipped
+        void Prefetch(Ptr<MobilityModel> a, Ptr<MobilityModel> b);
+        // to be connected to the Enqueue trace of the Wi-Fi MAC queues with Config::Connect, i.e. with context
+        // (see ConnectMacQueues); prefetches the link to the receiver of a unicast MPDU
+        void NotifyMacEnqueue(std::string context, Ptr<const WifiMpdu> mpdu);
+        // connects NotifyMacEnqueue to the MAC queues of all installed WifiNetDevices, i.e. links are ray traced
+        // while the MAC contends; to be called after the devices are installed
+        void ConnectMacQueues();
+        // a lookup waits at most this wall clock time for Sionna (0: no deadline), e.g. with the real time
+        // simulator; on a miss the last window of the link (paths evolved by their Doppler shift) or the
+        // log-distance model serves the lookup, while the reply fills the cache when it arrives
+        void SetDeadline(Time deadline);
         double GetStats();
+        double GetTtlRequestsSaved() const;
+        void PrintStats(std::ostream& os) const;
+        void PrintTimingStats(std::ostream& os) const;
+
+        /**
+         * TracedCallback signature for replies which arrived after the deadline.
+         *
+         * @param [in] txId The transmitter of the request.
+         * @param [in] rxId The receiver of the request.
+         * @param [in] durationMs The time from the request to the reply (in ms).
+         */
+        typedef void (*DeadlineMissTracedCallback)(uint32_t txId, uint32_t rxId, double durationMs);
 
     private:
         struct CacheKey
@@ -55,6 +155,11 @@ class SionnaPropagationCache : public ns3::Object
             uint32_t m_first;
             uint32_t m_second;
 
+            bool operator==(const CacheKey& other) const
+            {
+                return m_first == other.m_first && m_second == other.m_second;
+            }
+
             bool operator<(const CacheKey& other) const
             {
                 if (m_first != other.m_first)
@@ -74,7 +179,13 @@ class SionnaPropagationCache : public ns3::Object
                 : m_delay(delay),
                   m_loss(loss),
                   m_start_time(start_time),
-                  m_end_time(end_time)
+                  m_end_time(end_time),
+                  m_base_end_time(end_time),
+                  m_saved_windows(0),
+                  m_tx_node(0),
+                  m_prefetched(false),
+                  m_used(false),
+                  m_synth_time(start_time)
             {
             }
             
@@ -82,9 +193,102 @@ class SionnaPropagationCache : public ns3::Object
             double m_loss;
             Time m_start_time;
             Time m_end_time;
+            Time m_base_end_time; // end time without adaptive TTL scaling
+            int64_t m_saved_windows; // no. of unscaled windows already served beyond m_base_end_time
+            uint32_t m_tx_node; // TX of the request which computed this entry
+            bool m_prefetched; // computed in advance, i.e. not for the lookup which triggered the request
+            bool m_used; // read at least once
+            std::vector<std::complex<double>> m_csi; // per subcarrier; empty if not sent by Sionna
+            // path response: the paths at m_start_time (SoA); delay, loss and CSI are synthesized at m_synth_time
+            std::vector<double> m_path_gain_real;
+            std::vector<double> m_path_gain_imag;
+            std::vector<double> m_path_delay; // (in s)
+            std::vector<double> m_path_doppler; // (in Hz)
+            Time m_synth_time;
+            std::vector<double> m_ru_loss; // RU cache: effective loss (in dB) per RU, see m_ru_offset
+            // further bands of the SionnaHelper: band i at index i - 1; empty if not sent by Sionna
+            std::vector<double> m_band_loss;
+            std::vector<std::vector<std::complex<double>>> m_band_csi;
         };
 
-        CacheEntry GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+        // adaptive TTL: stability of a link observed over successive windows
+        struct LinkStability
+        {
+            LinkStability()
+                : m_ttl_scale(1.0),
+                  m_last_start_time(Time::Min()),
+                  m_last_loss(0)
+            {
+            }
+
+            double m_ttl_scale; // hint sent to Sionna
+            Time m_last_start_time; // last observed window
+            double m_last_loss;
+            std::vector<std::complex<double>> m_last_csi;
+        };
+
+        const CacheEntry& GetPropagationData(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+        // entry of the link at the current time if the link is ray traced; nullptr otherwise
+        const CacheEntry* GetRayTracedEntry(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+        // entry of the link valid at the given time; nullptr if none
+        CacheEntry* FindEntry(const CacheKey& key, Time current_time) const;
+        // sends a channel state request to Sionna and adds all links of the response to the cache; false if the
+        // deadline passed, i.e. the reply is received later
+        bool RequestChannelState(uint32_t txId, uint32_t rxId, Time current_time) const;
+        // waits for the reply of the last request until the deadline after start, or only polls if the request is
+        // already late; true if it can be received
+        bool WaitForReply(std::chrono::steady_clock::time_point start) const;
+        // entry serving a lookup which missed the deadline
+        const CacheEntry& GetDeadlineFallback(Ptr<MobilityModel> a, Ptr<MobilityModel> b, Time current_time) const;
+        // adds all links of the response to the cache; all but the requested link are marked as prefetched
+        void AddChannelStates(const ns3sionna::ChannelStateResponse& csi_response, const CacheKey* requested,
+                              Time current_time, bool neverExpire) const;
+        void AddServerTiming(const ns3sionna::ChannelStateResponse& csi_response) const;
+        void SendChannelStateRequest(uint32_t txId, uint32_t rxId, Time current_time, bool prefetch) const;
+        // receives the reply of the last request and adds its links; false if not yet there and not waiting
+        bool ReceiveChannelState(bool wait) const;
+        // receives the reply of a prefetch if available and sends the next queued prefetch
+        void PollPrefetch() const;
+        // adds the static links of the TX to the cache; false if the requested link has no path
+        bool ComputeImageMethod(uint32_t txId, const Vector& txPos, uint32_t rxId, Time current_time) const;
+        // sparse P2MP: adds the receivers to be computed together with the requested one
+        void AddRxNodes(uint32_t txId, uint32_t rxId, Time current_time, ns3sionna::ChannelStateRequest* request) const;
+        // traffic-aware fidelity: the frame currently sent on the link does not justify ray tracing
+        bool IsLowPriorityLink(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const;
+        // path response: delay, loss and CSI of the entry at the given time from the sum of its Doppler-shifted paths
+        void SynthesizeChannel(CacheEntry& entry, Time time, bool force = false) const;
+        // RU cache: effective loss of all RUs from the CSI of the entry
+        void UpdateRuLoss(CacheEntry& entry) const;
+        // tone ranges of all RUs for the Sionna bandwidth and FFT size
+        void ConfigureRuLayout() const;
+        // loss of the band from the loss of the entry (band 0) if Sionna did not send the band
+        double GetBandLoss(const CacheEntry& entry, uint32_t band) const;
+        // free space scaling of the loss from band 0 to the band (in dB)
+        double GetBandLossOffset(uint32_t band) const;
+        void AddTiming(const std::string& phase, double duration) const;
+        void UpdateStability(const CacheKey& key, Time start_time, double loss,
+                             std::vector<std::complex<double>>& csi) const;
+        void CountSavedRequests(CacheEntry& entry, Time current_time) const;
+        FidelityTier SelectTier(Ptr<MobilityModel> a, Ptr<MobilityModel> b, double txPowerDbm,
+                                double* wallsLoss = nullptr, bool* pruned = nullptr,
+                                uint32_t* walls = nullptr) const;
+        FidelityTier GetTierForMargin(double margin) const;
+        void ConfigureTierModels() const;
+
+        // distribution of the time spent per phase of a Sionna call (in ms)
+        struct TimingStats
+        {
+            TimingStats()
+                : m_histogram(1.0),
+                  m_sum(0),
+                  m_max(0)
+            {
+            }
+
+            Histogram m_histogram;
+            double m_sum;
+            double m_max;
+        };
 
         SionnaHelper *m_sionnaHelper;
         bool m_caching;
@@ -93,9 +297,121 @@ class SionnaPropagationCache : public ns3::Object
         mutable double m_cache_hits;
         mutable double m_cache_miss;
         bool m_optimize; // too far distance is not computed with raytracing
-        const double m_optimize_margin = 0;
+        // tiers are chosen by the estimated SNR margin (Friis RX power - noise floor, in dB); with the scene
+        // geometry the penetration loss of the walls between the nodes is subtracted as well
+        double m_tier_rt_margin; // min. margin for ray tracing
+        double m_tier_mw_margin; // min. margin for multi-wall (Friis + penetration loss)
+        double m_tier_ld_margin; // min. margin for log-distance; below Friis is used
+        double m_tier_hysteresis; // a link changes its tier only if the margin is off by this value
+        mutable std::map<CacheKey, FidelityTier> m_link_tier;
+        mutable double m_tier_lookups[NUM_TIERS];
+        mutable bool m_tier_models_configured;
+        Ptr<SionnaSceneGeometry> m_geometry;
+        mutable double m_geometry_lookups;
+        mutable double m_geometry_pruned; // lookups ray traced by Friis alone but not with the walls
+        mutable double m_geometry_walls; // sum of the walls crossed by the lookups
+        mutable double m_geometry_pruned_walls; // sum of the walls crossed by the pruned lookups
+        // walls between the nodes of a link for the positions of the nodes (in the order of the key)
+        struct LinkWalls
+        {
+            Vector m_first_position;
+            Vector m_second_position;
+            double m_loss;
+            uint32_t m_walls;
+        };
+        mutable std::map<CacheKey, LinkWalls> m_link_walls;
         Ptr<FriisPropagationLossModel> m_friisLossModel;
+        Ptr<LogDistancePropagationLossModel> m_logDistanceLossModel;
         Ptr<ConstantSpeedPropagationDelayModel> m_constSpeedDelayModel;
+        mutable std::map<std::string, TimingStats> m_timing;
+        mutable double m_timing_links; // no. of links computed by Sionna in calls with timing
+        mutable double m_timing_calls;
+        bool m_adaptive_ttl; // stretch the validity of links found stable
+        double m_ttl_max_loss_delta; // max. change of wideband loss between windows of a stable link (in dB)
+        double m_ttl_min_csi_corr; // min. correlation of the CSI between windows of a stable link
+        double m_ttl_max_scale;
+        mutable std::map<CacheKey, LinkStability> m_stability;
+        mutable double m_ttl_comparisons;
+        mutable double m_ttl_stable;
+        mutable double m_ttl_requests_saved;
+        Ptr<SionnaLookAheadController> m_lookAheadController; // optional; replaces the static sub_mode
+        Ptr<SionnaImageMethodEngine> m_imageMethod; // optional; local fidelity tier for static links
+        uint32_t m_im_validation_interval;
+        mutable double m_im_links; // entries added to the cache
+        mutable double m_im_samples; // links with paths; drives the validation sampling
+        mutable double m_im_validated;
+        mutable double m_im_loss_error_sum; // (in dB)
+        mutable double m_im_loss_error_max;
+        mutable double m_im_delay_error_sum; // (in ns)
+        mutable double m_im_csi_compared;
+        mutable double m_im_csi_corr_sum;
+        bool m_sparse_p2mp;
+        mutable double m_sparse_requests;
+        mutable double m_sparse_rx; // receivers requested
+        mutable double m_sparse_rx_all; // receivers Sionna would have computed otherwise
+        bool m_traffic_aware;
+        Time m_data_window; // links with unicast data within this time are ray traced for all frames
+        // the frame currently sent, set by the PhyTxBegin trace
+        uint32_t m_hint_tx_node;
+        bool m_hint_data; // unicast data
+        Time m_hint_time;
+        std::map<CacheKey, Time> m_last_data; // last unicast data frame per link
+        std::map<Mac48Address, uint32_t> m_mac_nodes;
+        mutable double m_traffic_lookups;
+        mutable double m_traffic_requests_avoided;
+        ns3sionna::ChannelStateRequest::Accuracy m_rt_accuracy;
+        // ray tracing budget reported by Sionna
+        mutable double m_rt_links;
+        mutable double m_rt_num_samples_sum;
+        mutable double m_rt_max_depth_sum;
+        mutable double m_rt_diffraction_links;
+        Time m_path_update_interval;
+        mutable double m_path_windows; // windows received as paths
+        mutable double m_path_sum;
+        mutable double m_path_syntheses;
+        bool m_ru_cache;
+        // RU layout: RUs of width index w (20/40/80/160 MHz) and type r are at m_ru_offset[w][r] ... + m_ru_count[w][r]
+        // in m_ru_loss; the tone ranges of RU i are m_ru_ranges[m_ru_range_index[i] ... m_ru_range_index[i + 1])
+        mutable double m_ru_layout_bw;
+        mutable int m_ru_layout_fft_size;
+        mutable uint32_t m_ru_offset[4][NUM_RU_TYPES];
+        mutable uint32_t m_ru_count[4][NUM_RU_TYPES];
+        mutable std::vector<std::pair<int32_t, int32_t>> m_ru_ranges; // tones relative to the channel center
+        mutable std::vector<uint32_t> m_ru_range_index;
+        mutable std::vector<uint32_t> m_ru_tone_csi; // CSI subcarrier of each HE tone, lowest tone first
+        mutable std::vector<double> m_ru_prefix_power; // scratch: prefix sums of |H|^2 over the HE tones
+        mutable double m_ru_windows;
+        mutable double m_band_lookups; // lookups of the loss of a band other than band 0
+        mutable double m_band_scaled; // of them served by the free space scaling of the band 0 loss
+        double m_warm_start_links;
+        double m_warm_start_time; // (in ms)
+        bool m_offline; // the Sionna session was closed after the warm start
+        // the last request sent to Sionna
+        struct SentRequest
+        {
+            uint32_t m_tx_node{0};
+            uint32_t m_rx_node{0};
+            Time m_time;
+            bool m_prefetch{false};
+            bool m_late{false}; // the lookup missed the deadline
+            std::chrono::steady_clock::time_point m_start;
+        };
+        mutable SentRequest m_request;
+        mutable std::deque<std::pair<uint32_t, uint32_t>> m_prefetch_queue; // links to be sent after the pending one
+        mutable double m_prefetch_requests; // sent
+        mutable double m_prefetch_skipped; // valid window or not ray traced
+        mutable double m_prefetch_waits; // lookups which had to wait for the reply of a prefetch
+        mutable double m_prefetch_late_hits; // of them served by the prefetch
+        mutable double m_prefetch_wait_time; // time blocked by prefetches (in ms)
+        Time m_deadline;
+        mutable std::map<CacheKey, CacheEntry> m_last_entries; // deadline: last expired window per link
+        mutable CacheEntry m_fallback_entry; // deadline: log-distance entry of the last miss
+        mutable double m_deadline_misses;
+        mutable double m_deadline_last_window; // of them served by the last window of the link
+        mutable double m_deadline_late_replies;
+        mutable double m_deadline_late_time; // sum of the time from request to late reply (in ms)
+        mutable double m_deadline_late_max;
+        TracedCallback<uint32_t, uint32_t, double> m_deadlineMissTrace;
 };
 
 } // namespace ns3
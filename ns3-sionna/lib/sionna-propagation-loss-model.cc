@@ -9,6 +9,7 @@
 #include "sionna-propagation-loss-model.h"
 
 #include "ns3/log.h"
+#include "ns3/uinteger.h"
 
 namespace ns3
 {
@@ -24,12 +25,19 @@ SionnaPropagationLossModel::GetTypeId()
         TypeId("ns3::SionnaPropagationLossModel")
             .SetParent<PropagationLossModel>()
             .SetGroupName("Propagation")
-            .AddConstructor<SionnaPropagationLossModel>();
+            .AddConstructor<SionnaPropagationLossModel>()
+            .AddAttribute("Band",
+                          "Band of the SionnaHelper whose loss is applied, e.g. 1 for the first band added by "
+                          "SionnaHelper::AddBand.",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&SionnaPropagationLossModel::m_band),
+                          MakeUintegerChecker<uint32_t>());
     return tid;
 }
 
 SionnaPropagationLossModel::SionnaPropagationLossModel()
-    : m_propagationCache(nullptr)
+    : m_propagationCache(nullptr),
+      m_band(0)
 {
 }
 
@@ -49,7 +57,7 @@ SionnaPropagationLossModel::DoCalcRxPower(double txPowerDbm,
                                           Ptr<MobilityModel> b) const
 {
     NS_ASSERT_MSG(m_propagationCache, "SionnaPropagationLossModel must have a SionnaPropagationCache.");
-    return (txPowerDbm - m_propagationCache->GetPropagationLoss(a, b, txPowerDbm));
+    return (txPowerDbm - m_propagationCache->GetPropagationLoss(a, b, txPowerDbm, m_band));
 }
 
 int64_t
@@ -37,6 +37,7 @@ class SionnaPropagationLossModel : public PropagationLossModel
         int64_t DoAssignStreams(int64_t stream) override;
 
         Ptr<SionnaPropagationCache> m_propagationCache;
+        uint32_t m_band;
         
 };
 
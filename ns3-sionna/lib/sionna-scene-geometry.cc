@@ -0,0 +1,912 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#include "sionna-scene-geometry.h"
+
+#include "ns3/log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("SionnaSceneGeometry");
+
+NS_OBJECT_ENSURE_REGISTERED(SionnaSceneGeometry);
+
+namespace
+{
+
+const float INF = std::numeric_limits<float>::infinity();
+
+// hits closer than this (in m) are the same surface, e.g. an edge shared by two triangles
+const float SAME_SURFACE_DISTANCE = 1e-3f;
+
+// segment ends closer than this (in m) to a surface are not counted, e.g. a node placed on the floor
+const float END_OFFSET = 1e-4f;
+
+// value of an attribute within the given XML tag
+std::string
+GetXmlAttribute(const std::string& tag, const std::string& attribute)
+{
+    std::string key = attribute + "=\"";
+    size_t pos = tag.find(key);
+    if (pos == std::string::npos)
+    {
+        return "";
+    }
+    pos += key.size();
+    return tag.substr(pos, tag.find('"', pos) - pos);
+}
+
+// size (in bytes) of a PLY property type
+size_t
+GetPlyTypeSize(const std::string& type)
+{
+    if (type == "char" || type == "uchar" || type == "int8" || type == "uint8")
+    {
+        return 1;
+    }
+    else if (type == "short" || type == "ushort" || type == "int16" || type == "uint16")
+    {
+        return 2;
+    }
+    else if (type == "int" || type == "uint" || type == "float" || type == "int32" || type == "uint32" ||
+             type == "float32")
+    {
+        return 4;
+    }
+    else if (type == "double" || type == "float64")
+    {
+        return 8;
+    }
+    NS_FATAL_ERROR("Unsupported PLY property type: " << type);
+    return 0;
+}
+
+// reads a little endian PLY value of the given type
+double
+ReadPlyValue(const char* data, const std::string& type)
+{
+    if (type == "float" || type == "float32")
+    {
+        float v;
+        std::memcpy(&v, data, sizeof(v));
+        return v;
+    }
+    else if (type == "double" || type == "float64")
+    {
+        double v;
+        std::memcpy(&v, data, sizeof(v));
+        return v;
+    }
+    else if (type == "int" || type == "int32")
+    {
+        int32_t v;
+        std::memcpy(&v, data, sizeof(v));
+        return v;
+    }
+    else if (type == "uint" || type == "uint32")
+    {
+        uint32_t v;
+        std::memcpy(&v, data, sizeof(v));
+        return v;
+    }
+    else if (type == "short" || type == "int16")
+    {
+        int16_t v;
+        std::memcpy(&v, data, sizeof(v));
+        return v;
+    }
+    else if (type == "ushort" || type == "uint16")
+    {
+        uint16_t v;
+        std::memcpy(&v, data, sizeof(v));
+        return v;
+    }
+    else if (type == "char" || type == "int8")
+    {
+        return static_cast<int8_t>(*data);
+    }
+    return static_cast<uint8_t>(*data);
+}
+
+} // namespace
+
+TypeId
+SionnaSceneGeometry::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::SionnaSceneGeometry")
+            .SetParent<Object>()
+            .SetGroupName("Propagation")
+            .AddConstructor<SionnaSceneGeometry>();
+    return tid;
+}
+
+SionnaSceneGeometry::SionnaSceneGeometry()
+    : m_num_triangles(0)
+{
+}
+
+SionnaSceneGeometry::~SionnaSceneGeometry()
+{
+}
+
+void
+SionnaSceneGeometry::Load(const std::string& sceneFile)
+{
+    std::ifstream in(sceneFile);
+    NS_ABORT_MSG_IF(!in, "Cannot open scene file " << sceneFile);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string xml = ss.str();
+
+    std::string dir = "";
+    size_t slash = sceneFile.find_last_of('/');
+    if (slash != std::string::npos)
+    {
+        dir = sceneFile.substr(0, slash + 1);
+    }
+
+    std::vector<BuildTriangle> triangles;
+
+    // <shape type="obj|ply"> <string name="filename" value="..."/> <ref id="mat-..." name="bsdf"/> </shape>
+    size_t pos = 0;
+    while ((pos = xml.find("<shape", pos)) != std::string::npos)
+    {
+        size_t end = xml.find("</shape>", pos);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        std::string shape = xml.substr(pos, end - pos);
+        std::string type = GetXmlAttribute(shape.substr(0, shape.find('>')), "type");
+        pos = end;
+
+        std::string filename = "";
+        std::string material = "";
+        size_t tag_pos = 0;
+        while ((tag_pos = shape.find('<', tag_pos + 1)) != std::string::npos)
+        {
+            std::string tag = shape.substr(tag_pos, shape.find('>', tag_pos) - tag_pos);
+            if (GetXmlAttribute(tag, "name") == "filename")
+            {
+                filename = GetXmlAttribute(tag, "value");
+            }
+            else if (tag.compare(0, 4, "<ref") == 0 && GetXmlAttribute(tag, "name") == "bsdf")
+            {
+                material = GetXmlAttribute(tag, "id");
+            }
+        }
+
+        // Sionna material names, e.g. mat-itu_concrete -> itu_concrete
+        if (material.compare(0, 4, "mat-") == 0)
+        {
+            material = material.substr(4);
+        }
+        uint32_t material_id = GetMaterialId(material);
+
+        if (type == "obj")
+        {
+            LoadObj(dir + filename, material_id, triangles);
+        }
+        else if (type == "ply")
+        {
+            LoadPly(dir + filename, material_id, triangles);
+        }
+        else
+        {
+            NS_LOG_WARN("Unsupported shape type " << type << " in " << sceneFile);
+        }
+    }
+
+    Build(triangles);
+
+    NS_LOG_INFO("Scene " << sceneFile << " loaded: " << m_num_triangles << " triangles, " << m_nodes.size()
+                << " BVH nodes, " << m_materials.size() << " materials");
+}
+
+uint32_t
+SionnaSceneGeometry::GetMaterialId(const std::string& material)
+{
+    auto it = std::find(m_materials.begin(), m_materials.end(), material);
+    if (it != m_materials.end())
+    {
+        return it - m_materials.begin();
+    }
+    m_materials.push_back(material);
+    return m_materials.size() - 1;
+}
+
+std::vector<SionnaSceneGeometry::Plane>
+SionnaSceneGeometry::GetPlanes() const
+{
+    // coplanar triangles are merged if normal and offset agree within these tolerances
+    const double NORMAL_TOLERANCE = 1e-3;
+    const double OFFSET_TOLERANCE = 1e-3; // in m
+
+    std::vector<Plane> planes;
+    for (size_t tri = 0; tri < m_tri_material.size(); tri++)
+    {
+        Vector n(m_e1[1][tri] * m_e2[2][tri] - m_e1[2][tri] * m_e2[1][tri],
+                 m_e1[2][tri] * m_e2[0][tri] - m_e1[0][tri] * m_e2[2][tri],
+                 m_e1[0][tri] * m_e2[1][tri] - m_e1[1][tri] * m_e2[0][tri]);
+        double n_len = n.GetLength();
+        if (n_len < 1e-9)
+        {
+            // padding or degenerate triangle
+            continue;
+        }
+        n = Vector(n.x / n_len, n.y / n_len, n.z / n_len);
+        // orientation does not matter for a plane; use the one with the first non-zero component positive
+        double first = std::fabs(n.x) > NORMAL_TOLERANCE ? n.x : (std::fabs(n.y) > NORMAL_TOLERANCE ? n.y : n.z);
+        if (first < 0)
+        {
+            n = Vector(-n.x, -n.y, -n.z);
+        }
+        double offset = n.x * m_v0[0][tri] + n.y * m_v0[1][tri] + n.z * m_v0[2][tri];
+
+        bool known = false;
+        for (const Plane& plane : planes)
+        {
+            if (std::fabs(plane.m_normal.x - n.x) < NORMAL_TOLERANCE &&
+                std::fabs(plane.m_normal.y - n.y) < NORMAL_TOLERANCE &&
+                std::fabs(plane.m_normal.z - n.z) < NORMAL_TOLERANCE &&
+                std::fabs(plane.m_offset - offset) < OFFSET_TOLERANCE && plane.m_material == m_tri_material[tri])
+            {
+                known = true;
+                break;
+            }
+        }
+        if (!known)
+        {
+            planes.push_back(Plane{n, offset, m_tri_material[tri]});
+        }
+    }
+    return planes;
+}
+
+const std::string&
+SionnaSceneGeometry::GetMaterialName(uint32_t material) const
+{
+    return m_materials.at(material);
+}
+
+void
+SionnaSceneGeometry::AddPolygon(const std::vector<float>& vertices, const std::vector<int64_t>& polygon,
+                                uint32_t material, std::vector<BuildTriangle>& triangles) const
+{
+    // triangle fan; the faces of the scenes are convex
+    for (size_t i = 1; i + 1 < polygon.size(); i++)
+    {
+        BuildTriangle tri;
+        int64_t idx[3] = {polygon[0], polygon[i], polygon[i + 1]};
+        bool valid = true;
+        for (int k = 0; k < 3; k++)
+        {
+            if (idx[k] < 0 || static_cast<size_t>(3 * idx[k] + 2) >= vertices.size())
+            {
+                valid = false;
+                break;
+            }
+            for (int c = 0; c < 3; c++)
+            {
+                tri.m_v[k][c] = vertices[3 * idx[k] + c];
+            }
+        }
+        if (!valid)
+        {
+            NS_LOG_WARN("Skipped face with invalid vertex index");
+            continue;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            tri.m_centroid[c] = (tri.m_v[0][c] + tri.m_v[1][c] + tri.m_v[2][c]) / 3.0f;
+        }
+        tri.m_material = material;
+        triangles.push_back(tri);
+    }
+}
+
+void
+SionnaSceneGeometry::LoadObj(const std::string& file, uint32_t material, std::vector<BuildTriangle>& triangles)
+{
+    std::ifstream in(file);
+    NS_ABORT_MSG_IF(!in, "Cannot open mesh " << file);
+
+    std::vector<float> vertices;
+    std::vector<int64_t> polygon;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream ls(line);
+        std::string key;
+        ls >> key;
+        if (key == "v")
+        {
+            float x = 0;
+            float y = 0;
+            float z = 0;
+            ls >> x >> y >> z;
+            vertices.push_back(x);
+            vertices.push_back(y);
+            vertices.push_back(z);
+        }
+        else if (key == "f")
+        {
+            // f v1/vt1/vn1 v2/vt2/vn2 ...; indices start at 1, negative indices are relative to the end
+            polygon.clear();
+            std::string vertex;
+            while (ls >> vertex)
+            {
+                int64_t idx = std::stoll(vertex.substr(0, vertex.find('/')));
+                polygon.push_back(idx > 0 ? idx - 1 : static_cast<int64_t>(vertices.size() / 3) + idx);
+            }
+            AddPolygon(vertices, polygon, material, triangles);
+        }
+    }
+}
+
+void
+SionnaSceneGeometry::LoadPly(const std::string& file, uint32_t material, std::vector<BuildTriangle>& triangles)
+{
+    std::ifstream in(file, std::ios::binary);
+    NS_ABORT_MSG_IF(!in, "Cannot open mesh " << file);
+
+    struct PlyProperty
+    {
+        std::string m_name;
+        std::string m_type; // item type for lists
+        std::string m_count_type; // empty if not a list
+    };
+
+    struct PlyElement
+    {
+        std::string m_name;
+        size_t m_count;
+        std::vector<PlyProperty> m_properties;
+    };
+
+    std::vector<PlyElement> elements;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        std::istringstream ls(line);
+        std::string key;
+        ls >> key;
+        if (key == "format")
+        {
+            std::string format;
+            ls >> format;
+            NS_ABORT_MSG_IF(format != "binary_little_endian", "Unsupported PLY format " << format << " in " << file);
+        }
+        else if (key == "element")
+        {
+            PlyElement element;
+            ls >> element.m_name >> element.m_count;
+            elements.push_back(element);
+        }
+        else if (key == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            std::string type;
+            ls >> type;
+            if (type == "list")
+            {
+                ls >> property.m_count_type >> property.m_type;
+            }
+            else
+            {
+                property.m_type = type;
+            }
+            ls >> property.m_name;
+            elements.back().m_properties.push_back(property);
+        }
+        else if (key == "end_header")
+        {
+            break;
+        }
+    }
+
+    std::vector<char> body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const char* data = body.data();
+    const char* data_end = data + body.size();
+
+    std::vector<float> vertices;
+    std::vector<int64_t> polygon;
+    for (const PlyElement& element : elements)
+    {
+        bool is_vertex = element.m_name == "vertex";
+        bool is_face = element.m_name == "face";
+        for (size_t i = 0; i < element.m_count; i++)
+        {
+            float pos[3] = {0, 0, 0};
+            for (const PlyProperty& property : element.m_properties)
+            {
+                if (property.m_count_type.empty())
+                {
+                    size_t size = GetPlyTypeSize(property.m_type);
+                    NS_ABORT_MSG_IF(data + size > data_end, "Truncated PLY file " << file);
+                    if (is_vertex && (property.m_name == "x" || property.m_name == "y" || property.m_name == "z"))
+                    {
+                        pos[property.m_name[0] - 'x'] = ReadPlyValue(data, property.m_type);
+                    }
+                    data += size;
+                }
+                else
+                {
+                    size_t count_size = GetPlyTypeSize(property.m_count_type);
+                    size_t item_size = GetPlyTypeSize(property.m_type);
+                    NS_ABORT_MSG_IF(data + count_size > data_end, "Truncated PLY file " << file);
+                    size_t count = ReadPlyValue(data, property.m_count_type);
+                    data += count_size;
+                    NS_ABORT_MSG_IF(data + count * item_size > data_end, "Truncated PLY file " << file);
+                    if (is_face && property.m_name == "vertex_indices")
+                    {
+                        polygon.clear();
+                        for (size_t k = 0; k < count; k++)
+                        {
+                            polygon.push_back(ReadPlyValue(data + k * item_size, property.m_type));
+                        }
+                        AddPolygon(vertices, polygon, material, triangles);
+                    }
+                    data += count * item_size;
+                }
+            }
+            if (is_vertex)
+            {
+                vertices.insert(vertices.end(), pos, pos + 3);
+            }
+        }
+    }
+}
+
+void
+SionnaSceneGeometry::Build(std::vector<BuildTriangle>& triangles)
+{
+    m_nodes.clear();
+    for (int c = 0; c < 3; c++)
+    {
+        m_v0[c].clear();
+        m_e1[c].clear();
+        m_e2[c].clear();
+    }
+    m_tri_material.clear();
+    m_num_triangles = triangles.size();
+
+    if (!triangles.empty())
+    {
+        m_nodes.reserve(2 * triangles.size() / LEAF_SIZE + 1);
+        BuildNode(triangles, 0, triangles.size());
+    }
+}
+
+uint32_t
+SionnaSceneGeometry::BuildNode(std::vector<BuildTriangle>& triangles, size_t begin, size_t end)
+{
+    uint32_t node_id = m_nodes.size();
+    m_nodes.push_back(BvhNode());
+
+    float bmin[3] = {INF, INF, INF};
+    float bmax[3] = {-INF, -INF, -INF};
+    float cmin[3] = {INF, INF, INF};
+    float cmax[3] = {-INF, -INF, -INF};
+    for (size_t i = begin; i < end; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                bmin[c] = std::min(bmin[c], triangles[i].m_v[k][c]);
+                bmax[c] = std::max(bmax[c], triangles[i].m_v[k][c]);
+            }
+            cmin[c] = std::min(cmin[c], triangles[i].m_centroid[c]);
+            cmax[c] = std::max(cmax[c], triangles[i].m_centroid[c]);
+        }
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        m_nodes[node_id].m_min[c] = bmin[c];
+        m_nodes[node_id].m_max[c] = bmax[c];
+    }
+
+    if (end - begin <= LEAF_SIZE)
+    {
+        m_nodes[node_id].m_index = m_tri_material.size() / LEAF_SIZE;
+        m_nodes[node_id].m_blocks = 1;
+        AddBlock(triangles, begin, end);
+        return node_id;
+    }
+
+    // median split along the axis with the largest extent of the centroids
+    int axis = 0;
+    for (int c = 1; c < 3; c++)
+    {
+        if (cmax[c] - cmin[c] > cmax[axis] - cmin[axis])
+        {
+            axis = c;
+        }
+    }
+    size_t mid = begin + (end - begin) / 2;
+    std::nth_element(triangles.begin() + begin,
+                     triangles.begin() + mid,
+                     triangles.begin() + end,
+                     [axis](const BuildTriangle& t1, const BuildTriangle& t2) {
+                         return t1.m_centroid[axis] < t2.m_centroid[axis];
+                     });
+
+    BuildNode(triangles, begin, mid); // left child follows its parent
+    uint32_t right = BuildNode(triangles, mid, end);
+    m_nodes[node_id].m_index = right;
+    m_nodes[node_id].m_blocks = 0;
+    return node_id;
+}
+
+void
+SionnaSceneGeometry::AddBlock(const std::vector<BuildTriangle>& triangles, size_t begin, size_t end)
+{
+    for (size_t i = 0; i < LEAF_SIZE; i++)
+    {
+        if (begin + i < end)
+        {
+            const BuildTriangle& tri = triangles[begin + i];
+            for (int c = 0; c < 3; c++)
+            {
+                m_v0[c].push_back(tri.m_v[0][c]);
+                m_e1[c].push_back(tri.m_v[1][c] - tri.m_v[0][c]);
+                m_e2[c].push_back(tri.m_v[2][c] - tri.m_v[0][c]);
+            }
+            m_tri_material.push_back(tri.m_material);
+        }
+        else
+        {
+            // padding: degenerate triangle
+            for (int c = 0; c < 3; c++)
+            {
+                m_v0[c].push_back(0);
+                m_e1[c].push_back(0);
+                m_e2[c].push_back(0);
+            }
+            m_tri_material.push_back(0);
+        }
+    }
+}
+
+void
+SionnaSceneGeometry::IntersectBlock(uint32_t block, const float o[3], const float d[3], float tMin, float tMax,
+                                    float t[LEAF_SIZE]) const
+{
+    const size_t base = block * LEAF_SIZE;
+    const float* __restrict v0x = m_v0[0].data() + base;
+    const float* __restrict v0y = m_v0[1].data() + base;
+    const float* __restrict v0z = m_v0[2].data() + base;
+    const float* __restrict e1x = m_e1[0].data() + base;
+    const float* __restrict e1y = m_e1[1].data() + base;
+    const float* __restrict e1z = m_e1[2].data() + base;
+    const float* __restrict e2x = m_e2[0].data() + base;
+    const float* __restrict e2y = m_e2[1].data() + base;
+    const float* __restrict e2z = m_e2[2].data() + base;
+    float* __restrict out = t;
+    // the ray in scalars, as the compiler cannot tell that o and d do not alias the output
+    const float ox = o[0];
+    const float oy = o[1];
+    const float oz = o[2];
+    const float dx = d[0];
+    const float dy = d[1];
+    const float dz = d[2];
+
+    // Moeller-Trumbore over all lanes of the block; the masks are arithmetic, as a bool select of the
+    // determinant or && keeps the compiler from vectorizing the loop (check with -fopt-info-vec)
+#if defined(__clang__)
+#pragma clang loop vectorize(assume_safety)
+#elif defined(__GNUC__)
+#pragma GCC ivdep
+#endif
+    for (uint32_t i = 0; i < LEAF_SIZE; i++)
+    {
+        float px = dy * e2z[i] - dz * e2y[i];
+        float py = dz * e2x[i] - dx * e2z[i];
+        float pz = dx * e2y[i] - dy * e2x[i];
+        float det = e1x[i] * px + e1y[i] * py + e1z[i] * pz;
+        // 1 for a non-degenerate triangle, else 0
+        float valid = static_cast<float>(std::fabs(det) > 1e-12f);
+        float inv_det = 1.0f / (det + (1.0f - valid));
+
+        float sx = ox - v0x[i];
+        float sy = oy - v0y[i];
+        float sz = oz - v0z[i];
+        float u = (sx * px + sy * py + sz * pz) * inv_det;
+
+        float qx = sy * e1z[i] - sz * e1y[i];
+        float qy = sz * e1x[i] - sx * e1z[i];
+        float qz = sx * e1y[i] - sy * e1x[i];
+        float v = (dx * qx + dy * qy + dz * qz) * inv_det;
+        float tt = (e2x[i] * qx + e2y[i] * qy + e2z[i] * qz) * inv_det;
+
+        int hit = static_cast<int>(valid) & (u >= -1e-6f) & (v >= -1e-6f) & (u + v <= 1.0f + 1e-6f) & (tt > tMin) &
+                  (tt < tMax);
+        out[i] = hit ? tt : INF;
+    }
+}
+
+bool
+SionnaSceneGeometry::Traverse(const float o[3], const float d[3], float tMin, float tMax, bool anyHit,
+                              std::vector<std::pair<float, uint32_t>>* hits) const
+{
+    if (m_nodes.empty())
+    {
+        return false;
+    }
+
+    float inv_d[3];
+    for (int c = 0; c < 3; c++)
+    {
+        inv_d[c] = 1.0f / d[c];
+    }
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    bool found = false;
+    float t[LEAF_SIZE];
+
+    while (stack_size > 0)
+    {
+        const BvhNode& node = m_nodes[stack[--stack_size]];
+
+        // slab test
+        float t0 = tMin;
+        float t1 = tMax;
+        for (int c = 0; c < 3; c++)
+        {
+            float ta = (node.m_min[c] - o[c]) * inv_d[c];
+            float tb = (node.m_max[c] - o[c]) * inv_d[c];
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        }
+        if (t0 > t1)
+        {
+            continue;
+        }
+
+        if (node.m_blocks > 0)
+        {
+            for (uint32_t block = node.m_index; block < node.m_index + node.m_blocks; block++)
+            {
+                IntersectBlock(block, o, d, tMin, tMax, t);
+                for (uint32_t i = 0; i < LEAF_SIZE; i++)
+                {
+                    if (t[i] < INF)
+                    {
+                        if (anyHit)
+                        {
+                            return true;
+                        }
+                        found = true;
+                        hits->push_back(std::make_pair(t[i], block * LEAF_SIZE + i));
+                    }
+                }
+            }
+        }
+        else
+        {
+            NS_ASSERT_MSG(stack_size + 2 <= 64, "BVH too deep");
+            stack[stack_size++] = node.m_index;
+            stack[stack_size++] = &node - m_nodes.data() + 1;
+        }
+    }
+    return found;
+}
+
+void
+SionnaSceneGeometry::CollectSegmentHits(const Vector& a, const Vector& b,
+                                        std::vector<std::pair<float, uint32_t>>& hits) const
+{
+    hits.clear();
+    Vector diff = b - a;
+    float length = diff.GetLength();
+    if (length <= 2 * END_OFFSET)
+    {
+        return;
+    }
+    float o[3] = {static_cast<float>(a.x), static_cast<float>(a.y), static_cast<float>(a.z)};
+    float d[3] = {static_cast<float>(diff.x / length), static_cast<float>(diff.y / length),
+                  static_cast<float>(diff.z / length)};
+
+    std::vector<std::pair<float, uint32_t>> all_hits;
+    Traverse(o, d, END_OFFSET, length - END_OFFSET, false, &all_hits);
+    std::sort(all_hits.begin(), all_hits.end());
+
+    for (const auto& hit : all_hits)
+    {
+        if (hits.empty() || hit.first - hits.back().first > SAME_SURFACE_DISTANCE)
+        {
+            hits.push_back(hit);
+        }
+    }
+}
+
+void
+SionnaSceneGeometry::CollectWalls(const Vector& a, const Vector& b, std::vector<uint32_t>& materials) const
+{
+    materials.clear();
+    std::vector<std::pair<float, uint32_t>> hits;
+    CollectSegmentHits(a, b, hits);
+
+    // side of each face the segment comes from, by the sign of the (unnormalized) face normal
+    Vector d = b - a;
+    std::vector<bool> front(hits.size());
+    for (size_t i = 0; i < hits.size(); i++)
+    {
+        uint32_t tri = hits[i].second;
+        double nx = m_e1[1][tri] * m_e2[2][tri] - m_e1[2][tri] * m_e2[1][tri];
+        double ny = m_e1[2][tri] * m_e2[0][tri] - m_e1[0][tri] * m_e2[2][tri];
+        double nz = m_e1[0][tri] * m_e2[1][tri] - m_e1[1][tri] * m_e2[0][tri];
+        front[i] = nx * d.x + ny * d.y + nz * d.z < 0;
+    }
+
+    std::vector<bool> paired(hits.size(), false);
+    for (size_t i = 0; i < hits.size(); i++)
+    {
+        if (paired[i])
+        {
+            continue;
+        }
+        uint32_t material = m_tri_material[hits[i].second];
+        for (size_t j = i + 1; j < hits.size(); j++)
+        {
+            if (!paired[j] && front[j] != front[i] && m_tri_material[hits[j].second] == material)
+            {
+                paired[j] = true;
+                break;
+            }
+        }
+        materials.push_back(material);
+    }
+}
+
+uint32_t
+SionnaSceneGeometry::GetNTriangles() const
+{
+    return m_num_triangles;
+}
+
+Vector
+SionnaSceneGeometry::GetBoundsMin() const
+{
+    if (m_nodes.empty())
+    {
+        return Vector(0, 0, 0);
+    }
+    return Vector(m_nodes[0].m_min[0], m_nodes[0].m_min[1], m_nodes[0].m_min[2]);
+}
+
+Vector
+SionnaSceneGeometry::GetBoundsMax() const
+{
+    if (m_nodes.empty())
+    {
+        return Vector(0, 0, 0);
+    }
+    return Vector(m_nodes[0].m_max[0], m_nodes[0].m_max[1], m_nodes[0].m_max[2]);
+}
+
+bool
+SionnaSceneGeometry::IsLos(const Vector& a, const Vector& b) const
+{
+    Vector diff = b - a;
+    float length = diff.GetLength();
+    if (length <= 2 * END_OFFSET)
+    {
+        return true;
+    }
+    float o[3] = {static_cast<float>(a.x), static_cast<float>(a.y), static_cast<float>(a.z)};
+    float d[3] = {static_cast<float>(diff.x / length), static_cast<float>(diff.y / length),
+                  static_cast<float>(diff.z / length)};
+    return !Traverse(o, d, END_OFFSET, length - END_OFFSET, true, nullptr);
+}
+
+uint32_t
+SionnaSceneGeometry::GetWallsCrossed(const Vector& a, const Vector& b) const
+{
+    std::vector<uint32_t> materials;
+    CollectWalls(a, b, materials);
+    return materials.size();
+}
+
+std::vector<uint32_t>
+SionnaSceneGeometry::GetMaterialsCrossed(const Vector& a, const Vector& b) const
+{
+    std::vector<uint32_t> materials;
+    CollectWalls(a, b, materials);
+    return materials;
+}
+
+double
+SionnaSceneGeometry::GetPenetrationLoss(const Vector& a, const Vector& b, double frequency, uint32_t* walls) const
+{
+    std::vector<uint32_t> materials;
+    CollectWalls(a, b, materials);
+    double loss = 0;
+    for (uint32_t material : materials)
+    {
+        loss += GetMaterialPenetrationLoss(m_materials[material], frequency);
+    }
+    if (walls)
+    {
+        *walls = materials.size();
+    }
+    return loss;
+}
+
+bool
+SionnaSceneGeometry::Intersect(const Vector& origin, const Vector& direction, double maxDistance, Hit& hit) const
+{
+    float o[3] = {static_cast<float>(origin.x), static_cast<float>(origin.y), static_cast<float>(origin.z)};
+    float d[3] = {static_cast<float>(direction.x), static_cast<float>(direction.y), static_cast<float>(direction.z)};
+
+    std::vector<std::pair<float, uint32_t>> hits;
+    if (!Traverse(o, d, END_OFFSET, maxDistance, false, &hits))
+    {
+        return false;
+    }
+    auto closest = std::min_element(hits.begin(), hits.end());
+    uint32_t tri = closest->second;
+
+    hit.m_t = closest->first;
+    hit.m_point = Vector(origin.x + hit.m_t * direction.x,
+                         origin.y + hit.m_t * direction.y,
+                         origin.z + hit.m_t * direction.z);
+    Vector n(m_e1[1][tri] * m_e2[2][tri] - m_e1[2][tri] * m_e2[1][tri],
+             m_e1[2][tri] * m_e2[0][tri] - m_e1[0][tri] * m_e2[2][tri],
+             m_e1[0][tri] * m_e2[1][tri] - m_e1[1][tri] * m_e2[0][tri]);
+    double n_len = n.GetLength();
+    double sign = (n.x * direction.x + n.y * direction.y + n.z * direction.z) > 0 ? -1.0 : 1.0;
+    hit.m_normal = Vector(sign * n.x / n_len, sign * n.y / n_len, sign * n.z / n_len);
+    hit.m_material = m_tri_material[tri];
+    return true;
+}
+
+double
+SionnaSceneGeometry::GetMaterialPenetrationLoss(const std::string& material, double frequency)
+{
+    // 3GPP TR 38.901 Table 7.4.3-1 (f in GHz); masonry without own entry is approximated by concrete,
+    // light building materials by wood
+    double f = frequency / 1e9;
+    if (material == "itu_vacuum")
+    {
+        return 0;
+    }
+    else if (material == "itu_metal")
+    {
+        return 100; // practically opaque
+    }
+    else if (material == "itu_glass")
+    {
+        return 2 + 0.2 * f;
+    }
+    else if (material == "itu_concrete" || material == "itu_brick" || material == "itu_marble" ||
+             material.find("ground") != std::string::npos)
+    {
+        return 5 + 4 * f;
+    }
+    // itu_wood, itu_plywood, itu_chipboard, itu_floorboard, itu_plasterboard, itu_ceiling_board and unknown
+    return 4.85 + 0.12 * f;
+}
+
+} // namespace ns3
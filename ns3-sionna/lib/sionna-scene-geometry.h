@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#ifndef SIONNA_SCENE_GEOMETRY_H
+#define SIONNA_SCENE_GEOMETRY_H
+
+#include "ns3/object.h"
+#include "ns3/vector.h"
+
+#include <string>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * @brief Geometry of a Sionna scene in ns3, i.e. the triangles of all OBJ/PLY meshes referenced by the
+ * scene XML together with their ITU material.
+ *
+ * The triangles are stored in a bounding volume hierarchy (BVH) whose leaves hold blocks of LEAF_SIZE
+ * triangles in SoA layout; the ray-triangle test of a leaf is branch-free so that the compiler vectorizes
+ * it over the LEAF_SIZE lanes (SSE or AVX, depending on the target). Used to answer line-of-sight and wall queries locally without a request to Sionna.
+ */
+class SionnaSceneGeometry : public Object
+{
+    public:
+        static TypeId GetTypeId();
+
+        SionnaSceneGeometry();
+        ~SionnaSceneGeometry() override;
+
+        /**
+         * Loads all meshes of the given Mitsuba scene XML file, e.g. "scratch/ns3-sionna/../models/simple_room/simple_room.xml";
+         * mesh files are relative to the directory of the XML file.
+         */
+        void Load(const std::string& sceneFile);
+
+        uint32_t GetNTriangles() const;
+
+        // axis-aligned bounding box of the scene
+        Vector GetBoundsMin() const;
+        Vector GetBoundsMax() const;
+
+        // true if no triangle lies on the segment between a and b
+        bool IsLos(const Vector& a, const Vector& b) const;
+
+        // no. of walls crossed by the segment between a and b; the entry and exit face of a closed wall or
+        // building are one wall, a single surface is a wall of its own
+        uint32_t GetWallsCrossed(const Vector& a, const Vector& b) const;
+
+        // the materials of the walls crossed by the segment between a and b, in order from a to b
+        std::vector<uint32_t> GetMaterialsCrossed(const Vector& a, const Vector& b) const;
+
+        // sum of the penetration losses (in dB) of all walls between a and b at the given frequency (in Hz);
+        // walls: no. of walls crossed
+        double GetPenetrationLoss(const Vector& a, const Vector& b, double frequency, uint32_t* walls = nullptr) const;
+
+        struct Hit
+        {
+            double m_t; // distance from the origin
+            Vector m_point;
+            Vector m_normal; // unit normal of the triangle, facing the origin
+            uint32_t m_material;
+        };
+
+        // closest intersection of the ray (origin, unit direction) within max. distance
+        bool Intersect(const Vector& origin, const Vector& direction, double maxDistance, Hit& hit) const;
+
+        // plane n * x = offset shared by one or more triangles
+        struct Plane
+        {
+            Vector m_normal; // unit normal
+            double m_offset;
+            uint32_t m_material;
+        };
+
+        // all distinct planes of the scene, e.g. the candidates for specular reflections
+        std::vector<Plane> GetPlanes() const;
+
+        const std::string& GetMaterialName(uint32_t material) const;
+
+        // penetration loss (in dB) of a single surface of the given ITU material at the given frequency (in Hz)
+        static double GetMaterialPenetrationLoss(const std::string& material, double frequency);
+
+        static const uint32_t LEAF_SIZE = 8;
+
+    private:
+        struct BvhNode
+        {
+            float m_min[3];
+            float m_max[3];
+            uint32_t m_index; // leaf: first block; inner node: right child (left child follows the node)
+            uint32_t m_blocks; // no. of blocks of a leaf; 0 for inner nodes
+        };
+
+        // a triangle while building the BVH
+        struct BuildTriangle
+        {
+            float m_v[3][3];
+            float m_centroid[3];
+            uint32_t m_material;
+        };
+
+        void LoadObj(const std::string& file, uint32_t material, std::vector<BuildTriangle>& triangles);
+        void LoadPly(const std::string& file, uint32_t material, std::vector<BuildTriangle>& triangles);
+        void AddPolygon(const std::vector<float>& vertices, const std::vector<int64_t>& polygon, uint32_t material,
+                        std::vector<BuildTriangle>& triangles) const;
+        uint32_t GetMaterialId(const std::string& material);
+
+        void Build(std::vector<BuildTriangle>& triangles);
+        uint32_t BuildNode(std::vector<BuildTriangle>& triangles, size_t begin, size_t end);
+        void AddBlock(const std::vector<BuildTriangle>& triangles, size_t begin, size_t end);
+
+        /**
+         * Traverses the BVH along the ray o + t * d with t in (tMin, tMax).
+         * Any hit: returns at the first hit; otherwise all hits are appended to hits as (t, triangle).
+         */
+        bool Traverse(const float o[3], const float d[3], float tMin, float tMax, bool anyHit,
+                      std::vector<std::pair<float, uint32_t>>* hits) const;
+
+        // ray test against one block; t of each lane or infinity if the lane is missed
+        void IntersectBlock(uint32_t block, const float o[3], const float d[3], float tMin, float tMax,
+                            float t[LEAF_SIZE]) const;
+
+        // hits on the segment a-b without duplicates, e.g. at edges shared by two triangles
+        void CollectSegmentHits(const Vector& a, const Vector& b, std::vector<std::pair<float, uint32_t>>& hits) const;
+
+        // material of each wall on the segment a-b: a face is paired with the next face of the same material
+        // facing the other way, i.e. the faces where the segment enters and leaves a slab
+        void CollectWalls(const Vector& a, const Vector& b, std::vector<uint32_t>& materials) const;
+
+        std::vector<BvhNode> m_nodes;
+
+        // triangles in blocks of LEAF_SIZE (SoA); unused slots are degenerate and never hit
+        std::vector<float> m_v0[3];
+        std::vector<float> m_e1[3];
+        std::vector<float> m_e2[3];
+        std::vector<uint32_t> m_tri_material;
+        uint32_t m_num_triangles;
+
+        std::vector<std::string> m_materials;
+};
+
+} // namespace ns3
+
+#endif // SIONNA_SCENE_GEOMETRY_H
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#include "sionna-spectrum-propagation-loss-model.h"
+
+#include "ns3/boolean.h"
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("SionnaSpectrumPropagationLossModel");
+
+NS_OBJECT_ENSURE_REGISTERED(SionnaSpectrumPropagationLossModel);
+
+TypeId
+SionnaSpectrumPropagationLossModel::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::SionnaSpectrumPropagationLossModel")
+            .SetParent<SpectrumPropagationLossModel>()
+            .SetGroupName("Propagation")
+            .AddConstructor<SionnaSpectrumPropagationLossModel>()
+            .AddAttribute("Normalize",
+                          "Apply only the frequency selectivity (mean gain of 1), i.e. the wideband loss is "
+                          "applied by the SionnaPropagationLossModel of the channel.",
+                          BooleanValue(true),
+                          MakeBooleanAccessor(&SionnaSpectrumPropagationLossModel::m_normalize),
+                          MakeBooleanChecker())
+            .AddAttribute("Band",
+                          "Band of the SionnaHelper whose CSI is applied, e.g. 1 for the first band added by "
+                          "SionnaHelper::AddBand.",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&SionnaSpectrumPropagationLossModel::m_band),
+                          MakeUintegerChecker<uint32_t>());
+    return tid;
+}
+
+SionnaSpectrumPropagationLossModel::SionnaSpectrumPropagationLossModel()
+    : m_propagationCache(nullptr),
+      m_normalize(true),
+      m_band(0)
+{
+}
+
+SionnaSpectrumPropagationLossModel::~SionnaSpectrumPropagationLossModel()
+{
+}
+
+void
+SionnaSpectrumPropagationLossModel::SetPropagationCache(Ptr<SionnaPropagationCache> propagationCache)
+{
+    m_propagationCache = propagationCache;
+}
+
+Ptr<SpectrumValue>
+SionnaSpectrumPropagationLossModel::DoCalcRxPowerSpectralDensity(Ptr<const SpectrumSignalParameters> params,
+                                                                 Ptr<const MobilityModel> a,
+                                                                 Ptr<const MobilityModel> b) const
+{
+    NS_ASSERT_MSG(m_propagationCache, "SionnaSpectrumPropagationLossModel must have a SionnaPropagationCache.");
+    Ptr<MobilityModel> mobility_a = ConstCast<MobilityModel>(a);
+    Ptr<MobilityModel> mobility_b = ConstCast<MobilityModel>(b);
+    Ptr<SpectrumValue> rx_psd = params->psd->Copy();
+
+    Time start_time;
+    Time end_time;
+    const std::vector<std::complex<double>>& csi =
+        m_propagationCache->GetChannelState(mobility_a, mobility_b, start_time, end_time, m_band);
+
+    if (csi.empty())
+    {
+        // flat: the wideband loss is either applied by the loss model of the channel or here
+        if (!m_normalize)
+        {
+            double tx_power_dbm = 10 * std::log10(Integral(*params->psd)) + 30;
+            double loss = m_propagationCache->GetPropagationLoss(mobility_a, mobility_b, tx_power_dbm, m_band);
+            *rx_psd *= std::pow(10.0, -loss / 10);
+        }
+        return rx_psd;
+    }
+
+    uint32_t id_a = a->GetObject<Node>()->GetId();
+    uint32_t id_b = b->GetObject<Node>()->GetId();
+    Ptr<const SpectrumModel> model = params->psd->GetSpectrumModel();
+    GainKey key = std::make_tuple(std::min(id_a, id_b), std::max(id_a, id_b), model->GetUid());
+
+    // the gain is computed once per window of the link
+    GainEntry& entry = m_gains[key];
+    if (!entry.m_gain || entry.m_start_time != start_time || entry.m_end_time != end_time)
+    {
+        entry.m_start_time = start_time;
+        entry.m_end_time = end_time;
+        entry.m_gain = ComputeGain(model, csi);
+    }
+    else
+    {
+        NS_LOG_DEBUG("Gain of " << id_a << " <-> " << id_b << " reused for window starting at " << start_time);
+    }
+
+    *rx_psd *= *entry.m_gain;
+    return rx_psd;
+}
+
+const SionnaSpectrumPropagationLossModel::BandMapping&
+SionnaSpectrumPropagationLossModel::GetBandMapping(Ptr<const SpectrumModel> model, uint32_t numSubcarriers) const
+{
+    SionnaHelper* helper = m_propagationCache->GetSionnaHelper();
+    double frequency = helper->GetBandFrequency(m_band);
+    double channel_bw = helper->GetBandChannelBandwidth(m_band);
+    BandMappingKey key = std::make_tuple(model->GetUid(), numSubcarriers, frequency, channel_bw);
+
+    auto it = m_band_mappings.find(key);
+    if (it != m_band_mappings.end())
+    {
+        return it->second;
+    }
+
+    // subcarrier k is at frequency + (k - numSubcarriers / 2) * spacing as in Sionna
+    double spacing = channel_bw / numSubcarriers;
+    double first_freq = frequency - static_cast<int64_t>(numSubcarriers / 2) * spacing;
+    int64_t last = static_cast<int64_t>(numSubcarriers) - 1;
+
+    BandMapping& mapping = m_band_mappings[key];
+    for (auto band = model->Begin(); band != model->End(); ++band)
+    {
+        int64_t begin = std::clamp<int64_t>(std::ceil((band->fl - first_freq) / spacing), 0, last + 1);
+        int64_t end = std::clamp<int64_t>(std::ceil((band->fh - first_freq) / spacing), 0, last + 1);
+        if (begin >= end)
+        {
+            // band narrower than the subcarrier spacing or outside of the Sionna bandwidth: nearest subcarrier
+            begin = std::clamp<int64_t>(std::llround((band->fc - first_freq) / spacing), 0, last);
+            end = begin + 1;
+        }
+        mapping.m_begin.push_back(begin);
+        mapping.m_end.push_back(end);
+    }
+    NS_LOG_INFO("Band mapping for spectrum model " << model->GetUid() << ": " << model->GetNumBands()
+                << " bands from " << numSubcarriers << " subcarriers");
+    return mapping;
+}
+
+Ptr<SpectrumValue>
+SionnaSpectrumPropagationLossModel::ComputeGain(Ptr<const SpectrumModel> model,
+                                                const std::vector<std::complex<double>>& csi) const
+{
+    size_t n = csi.size();
+    const BandMapping& mapping = GetBandMapping(model, n);
+
+    // |H|^2 per subcarrier; std::complex is stored as (real, imag), so the loop is vectorized
+    m_prefix_power.resize(n + 1);
+    const double* h = reinterpret_cast<const double*>(csi.data());
+    double* power = m_prefix_power.data() + 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        power[i] = h[2 * i] * h[2 * i] + h[2 * i + 1] * h[2 * i + 1];
+    }
+    m_prefix_power[0] = 0;
+    for (size_t i = 1; i <= n; i++)
+    {
+        m_prefix_power[i] += m_prefix_power[i - 1];
+    }
+
+    double scale = 1.0;
+    if (m_normalize)
+    {
+        double mean_power = m_prefix_power[n] / n;
+        scale = mean_power > 0 ? 1.0 / mean_power : 0.0;
+    }
+
+    // mean |H|^2 of the subcarriers of each band from the prefix sums
+    Ptr<SpectrumValue> gain = Create<SpectrumValue>(model);
+    const double* prefix = m_prefix_power.data();
+    const uint32_t* begin = mapping.m_begin.data();
+    const uint32_t* end = mapping.m_end.data();
+    Values::iterator values = gain->ValuesBegin();
+    for (size_t j = 0; j < mapping.m_begin.size(); j++)
+    {
+        values[j] = scale * (prefix[end[j]] - prefix[begin[j]]) / (end[j] - begin[j]);
+    }
+    if (m_normalize && scale == 0)
+    {
+        // no path: flat, the wideband loss is infinite anyway
+        *gain = 1.0;
+    }
+    return gain;
+}
+
+int64_t
+SionnaSpectrumPropagationLossModel::DoAssignStreams(int64_t stream)
+{
+    return 0;
+}
+
+} // namespace ns3
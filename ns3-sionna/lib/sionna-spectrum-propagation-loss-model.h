@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#ifndef SIONNA_SPECTRUM_PROPAGATION_LOSS_MODEL_H
+#define SIONNA_SPECTRUM_PROPAGATION_LOSS_MODEL_H
+
+#include "sionna-propagation-cache.h"
+
+#include "ns3/spectrum-propagation-loss-model.h"
+#include "ns3/spectrum-value.h"
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace ns3
+{
+
+/**
+ * @brief Frequency-selective loss from the CSI in the SionnaPropagationCache, i.e. the TX PSD is multiplied
+ * by |H(f)|^2 averaged over the Sionna subcarriers within each band of the spectrum model.
+ *
+ * With Normalize (default) only the shape of |H(f)|^2 is applied (mean gain of 1), so that the model is
+ * combined with the wideband SionnaPropagationLossModel on the channel; otherwise the absolute gain is
+ * applied and no other loss model must be added. Links without CSI, e.g. not ray traced, are flat. The CSI is
+ * the one of the configured Band of the SionnaHelper.
+ */
+class SionnaSpectrumPropagationLossModel : public SpectrumPropagationLossModel
+{
+    public:
+        static TypeId GetTypeId();
+
+        SionnaSpectrumPropagationLossModel();
+        ~SionnaSpectrumPropagationLossModel() override;
+
+        SionnaSpectrumPropagationLossModel(const SionnaSpectrumPropagationLossModel&) = delete;
+        SionnaSpectrumPropagationLossModel& operator=(const SionnaSpectrumPropagationLossModel&) = delete;
+
+        void SetPropagationCache(Ptr<SionnaPropagationCache> propagationCache);
+
+    private:
+        Ptr<SpectrumValue> DoCalcRxPowerSpectralDensity(Ptr<const SpectrumSignalParameters> params,
+                                                        Ptr<const MobilityModel> a,
+                                                        Ptr<const MobilityModel> b) const override;
+
+        int64_t DoAssignStreams(int64_t stream) override;
+
+        // subcarriers [m_begin[j], m_end[j]) of the CSI averaged for band j of a spectrum model
+        struct BandMapping
+        {
+            std::vector<uint32_t> m_begin;
+            std::vector<uint32_t> m_end;
+        };
+
+        // (spectrum model, no. of subcarriers, center frequency, bandwidth)
+        typedef std::tuple<SpectrumModelUid_t, uint32_t, double, double> BandMappingKey;
+
+        const BandMapping& GetBandMapping(Ptr<const SpectrumModel> model, uint32_t numSubcarriers) const;
+
+        // per band |H|^2 of the CSI
+        Ptr<SpectrumValue> ComputeGain(Ptr<const SpectrumModel> model,
+                                       const std::vector<std::complex<double>>& csi) const;
+
+        // gain of a link for a window of the cache
+        struct GainEntry
+        {
+            Time m_start_time;
+            Time m_end_time;
+            Ptr<SpectrumValue> m_gain;
+        };
+
+        // (node a, node b, spectrum model) with a < b
+        typedef std::tuple<uint32_t, uint32_t, SpectrumModelUid_t> GainKey;
+
+        Ptr<SionnaPropagationCache> m_propagationCache;
+        bool m_normalize;
+        uint32_t m_band;
+        mutable std::map<BandMappingKey, BandMapping> m_band_mappings;
+        mutable std::map<GainKey, GainEntry> m_gains;
+        mutable std::vector<double> m_prefix_power; // scratch: prefix sums of |H|^2 over the subcarriers
+};
+
+} // namespace ns3
+
+#endif // SIONNA_SPECTRUM_PROPAGATION_LOSS_MODEL_H
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#include "sionna-wifi-channel.h"
+
+#include "sionna-mobility-model.h"
+
+#include "ns3/double.h"
+#include "ns3/log.h"
+#include "ns3/nstime.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/wifi-ppdu.h"
+
+#include <algorithm>
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("SionnaWifiChannel");
+
+NS_OBJECT_ENSURE_REGISTERED(SionnaWifiChannel);
+
+namespace
+{
+
+bool
+IsStatic(Ptr<MobilityModel> mobility)
+{
+    Ptr<SionnaMobilityModel> sionna_mobility = DynamicCast<SionnaMobilityModel>(mobility);
+    return sionna_mobility && sionna_mobility->GetModel() == "Constant Position";
+}
+
+} // namespace
+
+TypeId
+SionnaWifiChannel::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::SionnaWifiChannel")
+            .SetParent<YansWifiChannel>()
+            .SetGroupName("Wifi")
+            .AddConstructor<SionnaWifiChannel>()
+            .AddAttribute("Margin",
+                          "A receiver is kept in the list of a TX if its RX power is at least its RX sensitivity "
+                          "minus this margin (dB).",
+                          DoubleValue(3.0),
+                          MakeDoubleAccessor(&SionnaWifiChannel::m_margin),
+                          MakeDoubleChecker<double>(0.0))
+            .AddAttribute("RefreshInterval",
+                          "Lifetime of a list of receivers with a mobile link not served by ray tracing.",
+                          TimeValue(Seconds(1.0)),
+                          MakeTimeAccessor(&SionnaWifiChannel::m_refresh_interval),
+                          MakeTimeChecker());
+    return tid;
+}
+
+SionnaWifiChannel::SionnaWifiChannel()
+    : m_propagationCache(nullptr),
+      m_margin(3.0),
+      m_refresh_interval(Seconds(1.0)),
+      m_ppdus(0),
+      m_candidates(0),
+      m_deliveries(0),
+      m_builds(0)
+{
+}
+
+SionnaWifiChannel::~SionnaWifiChannel()
+{
+}
+
+void
+SionnaWifiChannel::DoDispose()
+{
+    m_receivers.clear();
+    m_delivery_channels.clear();
+    YansWifiChannel::DoDispose();
+}
+
+void
+SionnaWifiChannel::SetPropagationCache(Ptr<SionnaPropagationCache> propagationCache, uint32_t band)
+{
+    m_propagationCache = propagationCache;
+
+    m_lossModel = CreateObject<SionnaPropagationLossModel>();
+    m_lossModel->SetAttribute("Band", UintegerValue(band));
+    m_lossModel->SetPropagationCache(propagationCache);
+    m_delayModel = CreateObject<SionnaPropagationDelayModel>();
+    m_delayModel->SetPropagationCache(propagationCache);
+
+    SetPropagationLossModel(m_lossModel);
+    SetPropagationDelayModel(m_delayModel);
+    m_receivers.clear();
+}
+
+std::vector<Ptr<YansWifiPhy>>
+SionnaWifiChannel::GetPhys() const
+{
+    std::vector<Ptr<YansWifiPhy>> phys;
+    for (std::size_t i = 0; i < GetNDevices(); i++)
+    {
+        Ptr<WifiNetDevice> device = DynamicCast<WifiNetDevice>(GetDevice(i));
+        if (!device)
+        {
+            continue;
+        }
+        for (const auto& phy : device->GetPhys())
+        {
+            Ptr<YansWifiPhy> yans_phy = DynamicCast<YansWifiPhy>(phy);
+            if (yans_phy && PeekPointer(yans_phy->GetChannel()) == this &&
+                std::find(phys.begin(), phys.end(), yans_phy) == phys.end())
+            {
+                phys.push_back(yans_phy);
+            }
+        }
+    }
+    return phys;
+}
+
+void
+SionnaWifiChannel::BuildReceiverList(Ptr<YansWifiPhy> sender, double txPowerDbm, ReceiverList& list) const
+{
+    m_builds += 1;
+    Time now = Simulator::Now();
+    Ptr<MobilityModel> sender_mobility = sender->GetMobility();
+    bool sender_static = IsStatic(sender_mobility);
+
+    std::vector<Ptr<YansWifiPhy>> receivers;
+    list.m_valid_until = Time::Max();
+    list.m_tx_power_dbm = txPowerDbm;
+    list.m_num_phys = GetNDevices();
+    for (const auto& phy : GetPhys())
+    {
+        if (phy == sender)
+        {
+            continue;
+        }
+        Ptr<MobilityModel> receiver_mobility = phy->GetMobility();
+        double rx_power_dbm = m_lossModel->CalcRxPower(txPowerDbm, sender_mobility, receiver_mobility) +
+                              phy->GetRxGain();
+        if (rx_power_dbm >= phy->GetRxSensitivity() - m_margin)
+        {
+            receivers.push_back(phy);
+        }
+
+        // the loss is constant within the window of a ray traced link (served by the lookup above)
+        Time start_time;
+        Time end_time;
+        m_propagationCache->GetChannelState(sender_mobility, receiver_mobility, start_time, end_time);
+        if (end_time > now)
+        {
+            list.m_valid_until = std::min(list.m_valid_until, end_time);
+        }
+        else if (!sender_static || !IsStatic(receiver_mobility))
+        {
+            list.m_valid_until = std::min(list.m_valid_until, now + m_refresh_interval);
+        }
+    }
+
+    list.m_delivery = nullptr;
+    if (!receivers.empty())
+    {
+        Ptr<YansWifiChannel>& delivery = m_delivery_channels[receivers];
+        if (!delivery)
+        {
+            delivery = CreateObject<YansWifiChannel>();
+            delivery->SetPropagationLossModel(m_lossModel);
+            delivery->SetPropagationDelayModel(m_delayModel);
+            for (const auto& phy : receivers)
+            {
+                delivery->Add(phy);
+            }
+        }
+        list.m_delivery = delivery;
+    }
+    NS_LOG_DEBUG("TX " << sender->GetDevice()->GetNode()->GetId() << ": " << receivers.size() << " of "
+                 << list.m_num_phys - 1 << " receivers until " << list.m_valid_until);
+}
+
+void
+SionnaWifiChannel::Send(Ptr<YansWifiPhy> sender, Ptr<const WifiPpdu> ppdu, double txPowerDbm) const
+{
+    NS_ASSERT_MSG(m_propagationCache, "SionnaWifiChannel must have a SionnaPropagationCache.");
+    m_ppdus += 1;
+
+    ReceiverList& list = m_receivers[sender];
+    if (Simulator::Now() >= list.m_valid_until || list.m_num_phys != GetNDevices() ||
+        txPowerDbm > list.m_tx_power_dbm)
+    {
+        BuildReceiverList(sender, txPowerDbm, list);
+    }
+    m_candidates += list.m_num_phys - 1;
+
+    if (list.m_delivery)
+    {
+        m_deliveries += list.m_delivery->GetNDevices();
+        list.m_delivery->Send(sender, ppdu, txPowerDbm);
+    }
+}
+
+void
+SionnaWifiChannel::PrintStats(std::ostream& os) const
+{
+    os << "SionnaWifiChannel: " << m_ppdus << " PPDUs, " << m_deliveries << " of " << m_candidates
+       << " receptions scheduled";
+    if (m_candidates > 0)
+    {
+        os << " (" << 100.0 * (1.0 - m_deliveries / m_candidates) << "% skipped)";
+    }
+    os << ", " << m_builds << " receiver lists built, " << m_delivery_channels.size() << " delivery channels"
+       << std::endl;
+}
+
+} // namespace ns3
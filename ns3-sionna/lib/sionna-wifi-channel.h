@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#ifndef SIONNA_WIFI_CHANNEL_H
+#define SIONNA_WIFI_CHANNEL_H
+
+#include "sionna-propagation-cache.h"
+#include "sionna-propagation-delay-model.h"
+#include "sionna-propagation-loss-model.h"
+
+#include "ns3/yans-wifi-channel.h"
+#include "ns3/yans-wifi-phy.h"
+
+#include <map>
+#include <vector>
+
+namespace ns3
+{
+
+class WifiPpdu;
+
+/**
+ * @brief YansWifiChannel which delivers a PPDU only to the receivers that can hear the TX.
+ *
+ * Per TX the receivers whose RX power is at least their RX sensitivity minus Margin are kept in a list,
+ * which is valid until the first window of the links of the TX in the SionnaPropagationCache ends (static
+ * links without ray tracing: forever, other links: RefreshInterval). Since YANS drops any signal below the
+ * RX sensitivity, i.e. it does not even add to the interference, the outcome is the same as with the
+ * YansWifiChannel as long as the loss does not drop by more than Margin within the list's lifetime, while
+ * each PPDU costs only a loss lookup and an event per receiver in the list.
+ *
+ * The PHYs must be SionnaWifiPhys (see SionnaWifiPhyHelper), since YansWifiChannel::Send is not virtual.
+ */
+class SionnaWifiChannel : public YansWifiChannel
+{
+    public:
+        static TypeId GetTypeId();
+
+        SionnaWifiChannel();
+        ~SionnaWifiChannel() override;
+
+        // creates the Sionna loss and delay models of the channel on the cache for the band of the SionnaHelper
+        void SetPropagationCache(Ptr<SionnaPropagationCache> propagationCache, uint32_t band = 0);
+
+        void Send(Ptr<YansWifiPhy> sender, Ptr<const WifiPpdu> ppdu, double txPowerDbm) const;
+
+        void PrintStats(std::ostream& os) const;
+
+    protected:
+        void DoDispose() override;
+
+    private:
+        // phys attached to this channel, i.e. all phys of the devices of the channel using it
+        std::vector<Ptr<YansWifiPhy>> GetPhys() const;
+
+        // receivers of a TX and when they have to be determined again
+        struct ReceiverList
+        {
+            Time m_valid_until{Time::Min()};
+            double m_tx_power_dbm{0}; // TX power the list was built for
+            std::size_t m_num_phys{0}; // phys on the channel when the list was built
+            Ptr<YansWifiChannel> m_delivery; // channel with just the receivers; nullptr if none
+        };
+
+        void BuildReceiverList(Ptr<YansWifiPhy> sender, double txPowerDbm, ReceiverList& list) const;
+
+        Ptr<SionnaPropagationCache> m_propagationCache;
+        Ptr<SionnaPropagationLossModel> m_lossModel;
+        Ptr<SionnaPropagationDelayModel> m_delayModel;
+        double m_margin;
+        Time m_refresh_interval;
+        mutable std::map<Ptr<YansWifiPhy>, ReceiverList> m_receivers; // per TX
+        // delivery channel per set of receivers, shared by the TXs, as channels are never removed from the ChannelList
+        mutable std::map<std::vector<Ptr<YansWifiPhy>>, Ptr<YansWifiChannel>> m_delivery_channels;
+        mutable double m_ppdus;
+        mutable double m_candidates;
+        mutable double m_deliveries;
+        mutable double m_builds;
+};
+
+} // namespace ns3
+
+#endif // SIONNA_WIFI_CHANNEL_H
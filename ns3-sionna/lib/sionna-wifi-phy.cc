@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#include "sionna-wifi-phy.h"
+
+#include "sionna-wifi-channel.h"
+
+#include "ns3/log.h"
+#include "ns3/wifi-ppdu.h"
+
+namespace ns3
+{
+
+NS_LOG_COMPONENT_DEFINE("SionnaWifiPhy");
+
+NS_OBJECT_ENSURE_REGISTERED(SionnaWifiPhy);
+
+TypeId
+SionnaWifiPhy::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::SionnaWifiPhy")
+            .SetParent<YansWifiPhy>()
+            .SetGroupName("Wifi")
+            .AddConstructor<SionnaWifiPhy>();
+    return tid;
+}
+
+SionnaWifiPhy::SionnaWifiPhy()
+{
+}
+
+SionnaWifiPhy::~SionnaWifiPhy()
+{
+}
+
+void
+SionnaWifiPhy::StartTx(Ptr<const WifiPpdu> ppdu)
+{
+    // YansWifiChannel::Send is not virtual
+    Ptr<SionnaWifiChannel> channel = DynamicCast<SionnaWifiChannel>(GetChannel());
+    if (!channel)
+    {
+        YansWifiPhy::StartTx(ppdu);
+        return;
+    }
+    channel->Send(this, ppdu, GetTxPowerForTransmission(ppdu) + GetTxGain());
+}
+
+SionnaWifiPhyHelper::SionnaWifiPhyHelper()
+{
+    for (auto& phy : m_phys)
+    {
+        phy.SetTypeId("ns3::SionnaWifiPhy");
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2024 Zubow
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Author: zubow@tkn.tu-berlin.de
+ */
+
+#ifndef SIONNA_WIFI_PHY_H
+#define SIONNA_WIFI_PHY_H
+
+#include "ns3/yans-wifi-helper.h"
+#include "ns3/yans-wifi-phy.h"
+
+namespace ns3
+{
+
+/**
+ * @brief YansWifiPhy which transmits over the SionnaWifiChannel it is attached to, i.e. only to the
+ * receivers that can hear it; on any other YansWifiChannel it behaves like the YansWifiPhy.
+ */
+class SionnaWifiPhy : public YansWifiPhy
+{
+    public:
+        static TypeId GetTypeId();
+
+        SionnaWifiPhy();
+        ~SionnaWifiPhy() override;
+
+        void StartTx(Ptr<const WifiPpdu> ppdu) override;
+};
+
+/**
+ * @brief YansWifiPhyHelper installing SionnaWifiPhys, to be used with a SionnaWifiChannel.
+ */
+class SionnaWifiPhyHelper : public YansWifiPhyHelper
+{
+    public:
+        SionnaWifiPhyHelper();
+};
+
+} // namespace ns3
+
+#endif // SIONNA_WIFI_PHY_H
@@ -11,6 +11,7 @@
 #include "lib/sionna-propagation-cache.h"
 #include "lib/sionna-propagation-delay-model.h"
 #include "lib/sionna-propagation-loss-model.h"
+#include "lib/sionna-scene-geometry.h"
 
 #include "ns3/applications-module.h"
 #include "ns3/core-module.h"
@@ -39,10 +40,20 @@ double get_channel_width(Ptr<NetDevice> nd)
     return wp->GetObject<YansWifiPhy>()->GetChannelWidth() * 1e6;
 }
 
+void
+LookAheadDecision(uint32_t txId, uint32_t lookAhead, double missRate, double usage, double latencyMs)
+{
+   std::cout << Simulator::Now().GetSeconds() << "s LAH TX " << txId << ": " << lookAhead << " (miss rate " << missRate
+             << ", usage " << usage << ", latency " << latencyMs << " ms)" << std::endl;
+}
+
 double
 RunSimulation(const std::string environment, const uint32_t numStas, const int channel_no, const bool mobile_scenario,
               const double mobile_speed, const int udp_pkt_interval, const bool caching,
-              const int mode, const int sub_mode, const bool verbose)
+              const int mode, const int sub_mode, const bool reply_first, const bool report_timing,
+              const bool adaptive_ttl, const bool adaptive_lah, const bool sparse_p2mp, const bool traffic_aware,
+              const bool loss_delay_only, const int rt_accuracy, const bool path_response, const int warm_start,
+              const bool prefetch, const int deadline, const bool client_mobility, const bool verbose)
 {
    NodeContainer wifiStaNodes;
    wifiStaNodes.Create(numStas);
@@ -58,6 +69,22 @@ RunSimulation(const std::string environment, const uint32_t numStas, const int c
    Ptr<SionnaPropagationCache> propagationCache = CreateObject<SionnaPropagationCache>();
    propagationCache->SetSionnaHelper(sionnaHelper);
    propagationCache->SetCaching(caching);
+   propagationCache->SetAdaptiveTtl(adaptive_ttl);
+   propagationCache->SetSparseP2mp(sparse_p2mp);
+   propagationCache->SetRayTracingAccuracy(static_cast<ns3sionna::ChannelStateRequest::Accuracy>(rt_accuracy));
+   // beacons alone do not trigger ray tracing; links with unicast data within the last second do
+   propagationCache->SetTrafficAware(traffic_aware, Seconds(1));
+   propagationCache->SetDeadline(MilliSeconds(deadline));
+   if (adaptive_lah)
+   {
+       // the look-ahead depth is controlled per TX instead of the static sub_mode
+       Ptr<SionnaLookAheadController> lahController = CreateObject<SionnaLookAheadController>();
+       if (verbose)
+       {
+           lahController->TraceConnectWithoutContext("Decision", MakeCallback(&LookAheadDecision));
+       }
+       propagationCache->SetLookAheadController(lahController);
+   }
 
    Ptr<SionnaPropagationDelayModel> delayModel = CreateObject<SionnaPropagationDelayModel>();
    delayModel->SetPropagationCache(propagationCache);
@@ -90,6 +117,17 @@ RunSimulation(const std::string environment, const uint32_t numStas, const int c
    mac.SetType("ns3::ApWifiMac", "Ssid", SsidValue(ssid), "BeaconGeneration", BooleanValue(true));
    apDevices = wifi.Install(phy, mac, wifiApNode);
 
+   if (traffic_aware)
+   {
+       Config::Connect("/NodeList/*/DeviceList/*/$ns3::WifiNetDevice/Phy/PhyTxBegin",
+                       MakeCallback(&SionnaPropagationCache::NotifyPhyTxBegin, propagationCache));
+   }
+   if (prefetch)
+   {
+       // links are requested when a unicast frame is queued, i.e. ray traced while the MAC contends
+       propagationCache->ConnectMacQueues();
+   }
+
    MobilityHelper mobility;
 
    if (mobile_scenario)
@@ -155,6 +193,23 @@ RunSimulation(const std::string environment, const uint32_t numStas, const int c
    sionnaHelper.Configure(get_center_freq(apDevices.Get(0)), get_channel_width(apDevices.Get(0)));
    sionnaHelper.SetMode(mode);
    sionnaHelper.SetSubMode(sub_mode);
+   sionnaHelper.SetReplyFirst(reply_first);
+   sionnaHelper.SetReportTiming(report_timing);
+   // YansWifiChannel only needs loss and delay
+   sionnaHelper.SetLossDelayOnly(loss_delay_only);
+   sionnaHelper.SetPathResponse(path_response);
+   if (client_mobility)
+   {
+       // the random walks are computed by ns3 with wall reflection on the scene meshes
+       Ptr<SionnaSceneGeometry> sceneGeometry = CreateObject<SionnaSceneGeometry>();
+       sceneGeometry->Load("scratch/ns3-sionna/../models/" + environment);
+       sionnaHelper.SetClientMobility(sceneGeometry);
+   }
+   if (warm_start > 0)
+   {
+       // static scenario: all links are loaded at start; 2: without Sionna afterwards
+       sionnaHelper.SetWarmStart(propagationCache, warm_start == 2);
+   }
 
    if (verbose)
    {
@@ -203,6 +258,8 @@ RunSimulation(const std::string environment, const uint32_t numStas, const int c
    Simulator::Destroy();
 
     std::cout << "Ns3-sionna: cache hit ratio: " <<  propagationCache->GetStats() << std::endl;
+    propagationCache->PrintStats(std::cout);
+    propagationCache->PrintTimingStats(std::cout);
 
    sionnaHelper.Destroy();
 
@@ -229,6 +286,19 @@ main(int argc, char* argv[])
    int sim_max_stas = 1;
    int mode = 3;
    int sub_mode = 16;
+   bool reply_first = false;
+   bool report_timing = false;
+   bool adaptive_ttl = false;
+   bool adaptive_lah = false;
+   bool sparse_p2mp = false;
+   bool traffic_aware = false;
+   bool loss_delay_only = false;
+   int rt_accuracy = 0;
+   bool path_response = false;
+   int warm_start = 0;
+   bool prefetch = false;
+   int deadline = 0;
+   bool client_mobility = false;
 
    CommandLine cmd(__FILE__);
    cmd.AddValue("channel", "The WiFi channel number", wifi_channel_num);
@@ -241,6 +311,19 @@ main(int argc, char* argv[])
    cmd.AddValue("caching", "Enable caching of propagation delay and loss", caching);
    cmd.AddValue("mode", "The Sionna mode", mode);
    cmd.AddValue("sub_mode", "The Sionna submode", sub_mode);
+   cmd.AddValue("reply_first", "Sionna returns the requested link first and computes the look-ahead in background", reply_first);
+   cmd.AddValue("report_timing", "Sionna reports the time per processing phase", report_timing);
+   cmd.AddValue("adaptive_ttl", "Stretch the validity of links with a stable channel", adaptive_ttl);
+   cmd.AddValue("adaptive_lah", "Mode 3: control the look-ahead per TX instead of using sub_mode", adaptive_lah);
+   cmd.AddValue("sparse_p2mp", "Modes 2/3: request only receivers in range and without a valid window", sparse_p2mp);
+   cmd.AddValue("traffic_aware", "Frames other than unicast data are not ray traced on links without recent data", traffic_aware);
+   cmd.AddValue("loss_delay_only", "Sionna computes only loss and delay, no OFDM channel/CSI", loss_delay_only);
+   cmd.AddValue("rt_accuracy", "Ray tracing budget per link: 0=fixed, 1=low, 2=medium, 3=high", rt_accuracy);
+   cmd.AddValue("path_response", "Sionna sends paths with Doppler; the channel evolves locally within a window", path_response);
+   cmd.AddValue("warm_start", "Static scenario: 1=all links are requested at start, 2=in addition the Sionna session is closed", warm_start);
+   cmd.AddValue("prefetch", "Links are requested from Sionna when a unicast frame is queued at the MAC", prefetch);
+   cmd.AddValue("deadline", "Max. wall clock time (in ms) a lookup waits for Sionna before a fallback is used (0: no deadline)", deadline);
+   cmd.AddValue("client_mobility", "The random walks are computed by ns3 instead of Sionna", client_mobility);
    cmd.AddValue("verbose", "Enable logging", verbose);
    cmd.Parse(argc, argv);
 
@@ -262,14 +345,16 @@ main(int argc, char* argv[])
    std::cout << "Config: ch " << wifi_channel_num << " mob " << mobile_scenario;
    std::cout << " speed " << mobile_speed << " pktinterval " << udp_pkt_interval;
    std::cout << " caching " << caching << " env " << environment;
-   std::cout << " mode " << mode << " submode " << sub_mode << std::endl;
+   std::cout << " mode " << mode << " submode " << sub_mode << " replyfirst " << reply_first << std::endl;
 
    uint32_t numStas = sim_min_stas;
    double computationTime = 0.0;
    while (computationTime < 2 * 60 * 60 && numStas <= (uint32_t)sim_max_stas) // as long as a single run is below 2h
    {
        computationTime = RunSimulation(environment, numStas, wifi_channel_num, mobile_scenario,
-                                       mobile_speed, udp_pkt_interval, caching, mode, sub_mode, verbose);
+                                       mobile_speed, udp_pkt_interval, caching, mode, sub_mode, reply_first, report_timing,
+                                       adaptive_ttl, adaptive_lah, sparse_p2mp, traffic_aware, loss_delay_only,
+                                       rt_accuracy, path_response, warm_start, prefetch, deadline, client_mobility, verbose);
        numStas = numStas * 2;
    }
 
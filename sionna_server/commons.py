@@ -1,3 +1,15 @@
+import time
+
+
+def add_phase_time(timing, phase, phase_start):
+    """
+    Adds the time since phase_start to the given phase (in ns) and returns the start of the next phase
+    """
+    now = time.perf_counter_ns()
+    timing[phase] += now - phase_start
+    return now
+
+
 def print_simulation_info(simulation_info):
     """
     Debugging
@@ -8,6 +20,12 @@ def print_simulation_info(simulation_info):
     print("    Frequency:", simulation_info.frequency)
     print("    Channel-BW:", simulation_info.channel_bw)
     print("    FFT size:", simulation_info.fft_size)
+    print("    Mode:", simulation_info.mode, "/", simulation_info.sub_mode)
+    print("    Reply first:", simulation_info.reply_first)
+    print("    Report timing:", simulation_info.report_timing)
+    print("    Client mobility:", simulation_info.client_mobility)
+    for band_id, band in enumerate(simulation_info.bands):
+        print("    Band %d:" % (band_id + 1), band.frequency, band.channel_bw, band.fft_size)
 
     print("Node Information:")
     for node_info in simulation_info.nodes:
@@ -0,0 +1,302 @@
+import bisect
+
+import mitsuba as mi
+import numpy as np
+
+
+class RandomWalkTrajectories:
+    """
+    Precomputed trajectories of all random walk nodes of a simulation.
+
+    Instead of walking one node at a time, all random walk nodes are advanced together up to a
+    configurable time horizon. The wall bounces of all nodes are found with a single batched ray
+    intersection per step in the Mitsuba variant already used by Sionna, i.e. no variant switching
+    is needed. Each trajectory is stored as a list of waypoints (time, position, velocity); position
+    lookups use bisection on the waypoint times. When a lookup goes beyond the horizon, all
+    trajectories are extended by another horizon. Each node draws from its own RNG stream seeded with
+    the seed and its node ID, hence its trajectory only depends on the seed, its ID and the scene, but
+    not on the lookups, e.g. of the different workers of a SionnaWorkerPool.
+    """
+
+    # time to next course change for static nodes (in ns)
+    INFINITE_DELAY = 3.6e12
+
+    # the intersection point is set back by one centimeter to prevent cases where the
+    # intersection point is found behind a wall
+    WALL_OFFSET = 0.01
+
+    # max. number of wall bounces per node and step; protects against nodes trapped in a corner
+    MAX_BOUNCES = 100
+
+    def __init__(self, mi_scene, node_info_dict, seed, horizon_ns, VERBOSE=False):
+        self.mi_scene = mi_scene
+        self.node_info_dict = node_info_dict
+        self.horizon_ns = horizon_ns
+        self.VERBOSE = VERBOSE
+        # random walk nodes are walked in a fixed order
+        self.walk_ids = [node_id for node_id in sorted(node_info_dict.keys())
+                         if node_info_dict[node_id]["model"] == "Random Walk"]
+        self.walk_idx = {node_id: idx for idx, node_id in enumerate(self.walk_ids)}
+        num = len(self.walk_ids)
+
+        # own RNG stream per node, so that the trajectory of a node only depends on the seed and its ID, i.e. not
+        # on the order of the draws of the nodes, which follows the horizons requested by the lookups
+        self.rngs = [np.random.RandomState([seed & 0xffffffff, node_id]) for node_id in self.walk_ids]
+
+        # current state of each walking node at the end of the computed horizon
+        self.pos = np.array([node_info_dict[n]["position"] for n in self.walk_ids], dtype=float).reshape(num, 3)
+        self.vel = np.zeros((num, 3))
+        self.time = np.zeros(num)
+        self.delay_left = np.zeros(num) # remaining time until next direction change
+        self.static = np.zeros(num, dtype=bool)
+
+        # waypoints per node
+        self.wp_times = {node_id: [] for node_id in self.walk_ids}
+        self.wp_pos = {node_id: [] for node_id in self.walk_ids}
+        self.wp_vel = {node_id: [] for node_id in self.walk_ids}
+
+        self.horizon_end = 0.0
+        if num > 0:
+            self.extend(self.horizon_ns)
+
+
+    def draw(self, idx, random_variable):
+        if random_variable[0] == "Uniform":
+            return self.rngs[idx].uniform(random_variable[1], random_variable[2])
+
+        elif random_variable[0] == "Constant":
+            return random_variable[1]
+
+        elif random_variable[0] == "Normal":
+            return self.rngs[idx].normal(random_variable[1], np.sqrt(random_variable[2]))
+
+
+    def add_waypoint(self, idx):
+        node_id = self.walk_ids[idx]
+        self.wp_times[node_id].append(self.time[idx])
+        self.wp_pos[node_id].append(self.pos[idx].copy())
+        self.wp_vel[node_id].append(self.vel[idx].copy())
+
+
+    def new_direction(self, idx):
+        '''
+        Chooses speed and direction for a new walk segment of a node
+        '''
+        node_info = self.node_info_dict[self.walk_ids[idx]]
+
+        speed = self.draw(idx, node_info["speed"])
+        direction = round(self.draw(idx, node_info["direction"]), 3)
+        self.vel[idx] = [np.cos(direction) * speed, np.sin(direction) * speed, 0.0]
+
+        # Calculate the remaining time to walk in the new direction
+        if node_info["mode"][0] == "Time":
+            self.delay_left[idx] = node_info["mode"][1]
+        elif node_info["mode"][0] == "Distance":
+            # If speed is 0, a random walk model with mode "Distance" becomes a constant position model
+            if speed == 0:
+                self.static[idx] = True
+                self.vel[idx] = 0.0
+                self.delay_left[idx] = np.inf
+            else:
+                self.delay_left[idx] = abs(node_info["mode"][1] / speed) * 1e9
+
+        if self.VERBOSE:
+            pos = self.pos[idx]
+            print(f"CourseChange x = {pos[0]}, y = {pos[1]}, z = {pos[2]}")
+
+        self.add_waypoint(idx)
+
+
+    def extend(self, until):
+        '''
+        Walks all random walk nodes until the given simulation time (in ns)
+        '''
+        bounces = np.zeros(len(self.walk_ids), dtype=int)
+
+        while True:
+            active = (self.time < until) & ~self.static
+            if not np.any(active):
+                break
+
+            for idx in np.nonzero(active & (self.delay_left <= 0))[0]:
+                self.new_direction(idx)
+                bounces[idx] = 0
+            active &= ~self.static
+
+            # time to walk in this step, limited by the next direction change and the horizon
+            leg = np.where(active, np.minimum(self.delay_left, until - self.time), 0.0)
+            speed = np.linalg.norm(self.vel, axis=1)
+            moving = active & (speed > 0) & (bounces < self.MAX_BOUNCES)
+
+            hit = np.zeros(len(self.walk_ids), dtype=bool)
+            hit_t = np.zeros(len(self.walk_ids))
+            hit_n = np.zeros((len(self.walk_ids), 3))
+
+            idx_moving = np.nonzero(moving)[0]
+            if len(idx_moving) > 0:
+                # Check if the next positions are inside the borders; one ray per moving node
+                direction = self.vel[idx_moving] / speed[idx_moving, None]
+                distance = speed[idx_moving] * leg[idx_moving] / 1e9
+
+                ray = mi.Ray3f(mi.Point3f(self.pos[idx_moving, 0], self.pos[idx_moving, 1], self.pos[idx_moving, 2]),
+                               mi.Vector3f(direction[:, 0], direction[:, 1], direction[:, 2]))
+                ray.maxt = mi.Float(distance)
+
+                si = self.mi_scene.ray_intersect(ray, ray_flags=mi.RayFlags.Minimal, coherent=False)
+
+                valid = np.array(si.is_valid(), dtype=bool)
+                hit[idx_moving] = valid
+                hit_t[idx_moving] = np.where(valid, np.array(si.t), 0.0)
+                hit_n[idx_moving] = np.stack([np.array(si.n.x), np.array(si.n.y), np.array(si.n.z)], axis=1)
+
+            # nodes walking freely until the end of the step
+            free = active & ~hit
+            self.pos[free] += self.vel[free] * leg[free, None] / 1e9
+            self.time[free] += leg[free]
+            self.delay_left[free] -= leg[free]
+
+            # nodes hitting a wall; the reflected direction is calculated in the z plane
+            for idx in np.nonzero(hit)[0]:
+                t = max(hit_t[idx] - self.WALL_OFFSET, 0.0)
+                direction = self.vel[idx] / speed[idx]
+                self.pos[idx] += t * direction
+
+                n = np.array([hit_n[idx][1], -hit_n[idx][0], 0.0])
+                n = n / np.linalg.norm(n)
+                direction = - (direction - 2 * np.dot(direction, n) * n)
+                self.vel[idx] = direction * speed[idx]
+
+                dt = (t / speed[idx]) * 1e9
+                self.time[idx] += dt
+                self.delay_left[idx] -= dt
+                bounces[idx] += 1
+                self.add_waypoint(idx)
+
+            # trapped nodes stay where they are for the rest of the step
+            trapped = active & ~moving
+            for idx in np.nonzero(trapped & (speed > 0))[0]:
+                self.vel[idx] = 0.0
+                self.add_waypoint(idx)
+            self.time[trapped] += leg[trapped]
+            self.delay_left[trapped] -= leg[trapped]
+
+        self.horizon_end = until
+
+
+    def lookup(self, node_id, simulation_time):
+        '''
+        Returns the index of the waypoint valid at the given time
+        '''
+        # always by one horizon at a time, so that the legs of the walk, i.e. its rounding, do not depend on the
+        # lookup times
+        while simulation_time >= self.horizon_end:
+            self.extend(self.horizon_end + self.horizon_ns)
+
+        times = self.wp_times[node_id]
+        return max(bisect.bisect_right(times, simulation_time) - 1, 0)
+
+
+    def get_position_and_velocity(self, node_id, simulation_time):
+        # If node position is constant, return current position
+        if node_id not in self.wp_times:
+            return self.node_info_dict[node_id]["position"], [0.0, 0.0, 0.0]
+
+        k = self.lookup(node_id, simulation_time)
+        if not self.wp_times[node_id]:
+            return self.node_info_dict[node_id]["position"], [0.0, 0.0, 0.0]
+
+        vel = self.wp_vel[node_id][k]
+        pos = self.wp_pos[node_id][k] + vel * max(simulation_time - self.wp_times[node_id][k], 0.0) / 1e9
+        return pos.tolist(), vel.tolist()
+
+
+    def get_delay_left(self, node_id, simulation_time):
+        '''
+        Time (in ns) until the node changes its velocity for the next time
+        '''
+        if node_id not in self.wp_times:
+            return self.INFINITE_DELAY
+
+        k = self.lookup(node_id, simulation_time)
+        times = self.wp_times[node_id]
+        if k + 1 < len(times):
+            return times[k + 1] - simulation_time
+
+        idx = self.walk_idx[node_id]
+        if self.static[idx]:
+            return self.INFINITE_DELAY
+        # next course change lies beyond the computed horizon
+        return max(self.horizon_end - simulation_time, 0.0) + max(self.delay_left[idx], 0.0)
+
+
+class ClientTrajectories:
+    """
+    Trajectories of the random walk nodes computed by ns3 (client mobility), i.e. no mobility work is done here.
+
+    Each ChannelStateRequest carries the waypoints of all walking nodes from the request time until the
+    trajectory horizon of ns3; they replace the waypoints known so far. Same lookup interface as
+    RandomWalkTrajectories.
+    """
+
+    INFINITE_DELAY = RandomWalkTrajectories.INFINITE_DELAY
+
+    def __init__(self, node_info_dict):
+        self.node_info_dict = node_info_dict
+
+        # waypoints per walking node
+        self.wp_times = dict()
+        self.wp_pos = dict()
+        self.wp_vel = dict()
+        self.end_time = dict() # the walk is known until this time (in ns)
+        self.stopped = dict() # no movement after the last waypoint
+
+
+    def update(self, trajectories):
+        '''
+        Takes over the trajectories of a ChannelStateRequest
+        '''
+        for trajectory in trajectories:
+            node_id = trajectory.node
+            self.wp_times[node_id] = [wp.time for wp in trajectory.waypoints]
+            self.wp_pos[node_id] = [np.array([wp.position.x, wp.position.y, wp.position.z])
+                                    for wp in trajectory.waypoints]
+            self.wp_vel[node_id] = [np.array([wp.velocity.x, wp.velocity.y, wp.velocity.z])
+                                    for wp in trajectory.waypoints]
+            self.end_time[node_id] = trajectory.end_time
+            self.stopped[node_id] = trajectory.stopped
+
+
+    def lookup(self, node_id, simulation_time):
+        '''
+        Returns the index of the waypoint valid at the given time
+        '''
+        return max(bisect.bisect_right(self.wp_times[node_id], simulation_time) - 1, 0)
+
+
+    def get_position_and_velocity(self, node_id, simulation_time):
+        # If node position is constant or not walked yet, return the initial position
+        if not self.wp_times.get(node_id):
+            return self.node_info_dict[node_id]["position"], [0.0, 0.0, 0.0]
+
+        k = self.lookup(node_id, simulation_time)
+        vel = self.wp_vel[node_id][k]
+        pos = self.wp_pos[node_id][k] + vel * max(simulation_time - self.wp_times[node_id][k], 0.0) / 1e9
+        return pos.tolist(), vel.tolist()
+
+
+    def get_delay_left(self, node_id, simulation_time):
+        '''
+        Time (in ns) until the node changes its velocity for the next time
+        '''
+        if not self.wp_times.get(node_id):
+            return self.INFINITE_DELAY
+
+        k = self.lookup(node_id, simulation_time)
+        times = self.wp_times[node_id]
+        if k + 1 < len(times):
+            return times[k + 1] - simulation_time
+
+        if self.stopped[node_id]:
+            return self.INFINITE_DELAY
+        # next course change lies beyond the trajectory sent by ns3
+        return max(self.end_time[node_id] - simulation_time, 0.0)
@@ -0,0 +1,46 @@
+import time
+
+from sionna.rt import load_scene
+
+
+class ScenePool:
+    """
+    Keeps the last loaded Sionna scene, keyed by scene file.
+
+    The pool outlives a single simulation job (SimInitMessage session), so that consecutive runs on the same
+    scene, e.g. a seed sweep, skip parsing the scene and its meshes. Mitsuba/Dr.Jit keep the kernels compiled
+    for a scene within the process, hence they are reused as well. In Sionna 0.x the Scene is a process-wide
+    singleton, i.e. loading a scene replaces the previous one; hence at most one scene is kept and its
+    frequency is set again on every reuse. max_size=0 disables the pool.
+    """
+
+    def __init__(self, max_size=1):
+        self.max_size = max_size
+        self.filepath = None
+        self.scene = None
+
+
+    def acquire(self, filepath, frequency):
+        '''
+        Returns (scene, load time in s, whether the scene was taken from the pool)
+        '''
+        start_time = time.time()
+
+        cached = self.max_size > 0 and self.scene is not None and self.filepath == filepath
+        if cached:
+            scene = self.scene
+            # remove everything placed by the previous job
+            for name in list(scene.transmitters.keys()) + list(scene.receivers.keys()):
+                scene.remove(name)
+        else:
+            # the singleton scene is replaced, i.e. a kept scene is not valid anymore
+            self.filepath = None
+            self.scene = None
+            scene = load_scene(filepath)
+        scene.frequency = frequency
+
+        if self.max_size > 0:
+            self.filepath = filepath
+            self.scene = scene
+
+        return scene, time.time() - start_time, cached
@@ -1,4 +1,5 @@
 import argparse
+import collections
 import math
 
 # ZMQ, PB
@@ -9,6 +10,9 @@ import message_pb2
 import os
 
 from commons import *
+from mobility import ClientTrajectories, RandomWalkTrajectories
+from scene_pool import ScenePool
+from worker_pool import SionnaWorkerPool
 
 gpu_num = 0 # Use "" to use the CPU
 os.environ["CUDA_VISIBLE_DEVICES"] = f"{gpu_num}"
@@ -35,14 +39,24 @@ from sionna.channel import cir_to_ofdm_channel, subcarrier_frequencies
 from sionna.rt.antenna import iso_pattern
 sionna.config.seed = 40
 
-class CacheEntry:
-    def __init__(self, sim_time, ttl, value):
-        self.sim_time = sim_time
-        self.ttl = ttl
-        self.value = value
-
-    def debug(self):
-        return str(self.sim_time) + "/" + str(self.ttl) + "/..."
+# validity of channels between static nodes (in ns)
+INFINITE_END_TIME = np.iinfo(np.int64).max
+
+# ray tracing budget
+RT_NUM_SAMPLES = int(1e6) # with ACCURACY_FIXED
+# per accuracy class: (min. num_samples, max. num_samples, max. depth)
+RT_BUDGET = {
+    message_pb2.ChannelStateRequest.ACCURACY_LOW: (1e4, 2e5, 2),
+    message_pb2.ChannelStateRequest.ACCURACY_MEDIUM: (3e4, 1e6, 3),
+    message_pb2.ChannelStateRequest.ACCURACY_HIGH: (1e5, 4e6, 8),
+}
+RT_BUDGET_REF_DISTANCE = 5.0 # beyond, num_samples grow with the square of the link distance (in m)
+RT_DENSITY_RADIUS = 20.0 # objects within this distance of TX or RX count for the scene density (in m)
+RT_DENSE_OBJECTS = 10 # min. no. of objects around the link for diffraction
+RT_DIFFRACTION_DISTANCE = 50.0 # min. link distance for diffraction below ACCURACY_HIGH (in m)
+
+# path response: the paths of a link stay valid while TX and RX together move less than this distance (in m)
+PATH_STATIONARITY_DISTANCE = 1.0
 
 class SionnaEnv:
     """
@@ -52,15 +66,36 @@ class SionnaEnv:
     author: Pilz, Zubow
     """
 
-    def __init__(self, rt_calc_diffraction, rt_max_depth=5, rt_max_parallel_links=32, est_csi=True, VERBOSE=True):
+    def __init__(self, rt_calc_diffraction, rt_max_depth=5, rt_max_parallel_links=32, est_csi=True,
+                 mobility_horizon=10.0, scene_pool=None, VERBOSE=True):
         self.rt_calc_diffraction = rt_calc_diffraction
         self.rt_max_depth = rt_max_depth
         self.rt_max_parallel_links = rt_max_parallel_links
         self.est_csi = est_csi
+        self.mobility_horizon = int(mobility_horizon * 1e9) # in ns
+        self.scene_pool = scene_pool if scene_pool is not None else ScenePool(max_size=0)
+        self.scene_load_time = 0.0
+        self.scene_cached = False
         self.VERBOSE = VERBOSE
         self.node_info_dict = {}
         self.last_placed_nodes = [] # name of TX/RX placed during last channel computation
-        self.pos_velo_cache = dict()
+        self.socket_open = True
+        self.last_call_times = []
+        self.num_processed_csi_req = 0
+        self.reply_first = False
+        self.report_timing = False
+        self.loss_delay_only = False
+        self.path_response = False
+        self.client_mobility = False # the random walks are computed by ns3
+        self.bands = [] # further bands (frequency, channel_bw, fft_size) besides the one of the scene
+        self.timing = collections.defaultdict(int) # time per phase of current request (in ns)
+        self.background_time = 0 # time spent on look-ahead since the last response (in ns)
+        self.last_serialization_time = 0 # (in ns)
+        self.background_jobs = collections.deque() # look-ahead still to be computed: (tx node, windows)
+        self.pending_csi = [] # look-ahead computed but not yet delivered to ns3
+        self.ttl_scale = dict() # adaptive TTL hint of ns3 per link: (tx node, rx node) -> factor
+        self.rt_accuracy = dict() # accuracy class of the last request per TX
+        self.object_boxes = (np.zeros((0, 3)), np.zeros((0, 3))) # bounding boxes (min, max) of the scene objects
 
 
     def store_simulation_info(self, simulation_info):
@@ -69,10 +104,18 @@ class SionnaEnv:
         """
         # global gpus
 
-        # Load the sionna scene
+        # Load the sionna scene or take it from the pool of already loaded scenes
         filepath = "./../models/" + simulation_info.scene_fname
-        self.scene = load_scene(filepath)
+        self.scene, self.scene_load_time, self.scene_cached = self.scene_pool.acquire(filepath, simulation_info.frequency)
+        print("Scene %s ready in %.2f sec (%s)" % (simulation_info.scene_fname, self.scene_load_time,
+                                                  "cached" if self.scene_cached else "loaded"))
         self.mode = simulation_info.mode
+        self.reply_first = simulation_info.reply_first
+        self.report_timing = simulation_info.report_timing
+        self.loss_delay_only = simulation_info.loss_delay_only
+        self.path_response = simulation_info.path_response
+        self.client_mobility = simulation_info.client_mobility
+        self.object_boxes = self.get_object_boxes()
 
         if simulation_info.sub_mode > -1:
             # set from ns-3
@@ -81,17 +124,6 @@ class SionnaEnv:
             # use value set by sionna
             self.sub_mode = self.rt_max_parallel_links
 
-        # Load the mitsuba scene used by the mobility model
-        # Mobility model uses mitsuba SCALAR variant
-        mi.set_variant('scalar_rgb')
-        self.mi_scene = mi.load_file(filepath, parallel=False)
-
-        # Set the mitsuba variant back to how Sionna configures it
-        if len(gpus) > 0:
-            mi.set_variant('cuda_ad_rgb')
-        else:
-            mi.set_variant('llvm_ad_rgb')
-
         # SISO mode only
         # Configure antenna array for all transmitters
         self.scene.tx_array = PlanarArray(num_rows=1,
@@ -111,6 +143,7 @@ class SionnaEnv:
         self.scene.frequency = simulation_info.frequency
         self.scene.channel_bw = simulation_info.channel_bw
         self.scene.fft_size = simulation_info.fft_size
+        self.bands = [(band.frequency, band.channel_bw, band.fft_size) for band in simulation_info.bands]
 
         # If set to False, ray tracing will be done per antenna element (slower for large arrays)
         self.scene.synthetic_array = True
@@ -162,17 +195,18 @@ class SionnaEnv:
                 self.node_info_dict[node_info.id] = {
                     "model": "Random Walk",
                     "position": [position.x, position.y, position.z],
-                    "velocity": [0.0, 0.0, 0.0],
                     "mode": mode,
                     "speed": speed,
-                    "direction": direction,
-                    "last update": 0,
-                    "delay left": 0
+                    "direction": direction
                 }
 
-        # create cache for mode 3
-        for node_id in list(self.node_info_dict.keys()):
-            self.pos_velo_cache[node_id] = []
+        if self.client_mobility:
+            # the trajectories are sent by ns3 with each request
+            self.trajectories = ClientTrajectories(self.node_info_dict)
+        else:
+            # precompute the trajectories of all random walk nodes; the mitsuba scene loaded by Sionna is reused
+            self.trajectories = RandomWalkTrajectories(self.scene.mi_scene, self.node_info_dict, simulation_info.seed,
+                                                       self.mobility_horizon, self.VERBOSE)
 
         # check mode compatibility
         if self.mode == 3 or self.mode == 2:
@@ -194,38 +228,41 @@ class SionnaEnv:
             # worst case coherence time
             print("Running mode %d with Tc=%.2f ms" % (self.mode, self.chan_coh_time_mode23 / 1e6))
 
-        num_nodes = len(self.node_info_dict)
-
-        # how long to store computed position values from mobility
-        self.max_pos_cache_age = max(1e9,  num_nodes * math.ceil(self.sub_mode / num_nodes) * self.chan_coh_time_mode23)
-
         if self.VERBOSE:
             print_simulation_info(simulation_info)
 
 
     def calculate_channel_state(self, channel_state_request, reply_wrapper):
+        request_start = time.perf_counter_ns()
+        self.timing.clear()
 
         tx_node = channel_state_request.tx_node
         mand_rx_node = channel_state_request.rx_node # this rx node must be included in result set
         simulation_time = channel_state_request.time
+        if self.client_mobility:
+            self.trajectories.update(channel_state_request.trajectories)
 
-        # remove all entries from cache
-        self.remove_all_cached_entries(simulation_time)
-
-        # Remove all last transmitter and receiver
-        for node_name in self.last_placed_nodes:
-            self.scene.remove(node_name)
-        self.last_placed_nodes.clear()
+        # ns3 found the link to be stable (or not anymore)
+        self.set_ttl_scale(tx_node, mand_rx_node, channel_state_request.ttl_scale)
+        self.rt_accuracy[tx_node] = channel_state_request.accuracy
 
         # Get all receiver IDs
         if self.mode == 1: # P2P
             all_rx_nodes = [mand_rx_node]
+        elif len(channel_state_request.rx_nodes) > 0: # P2MP with receivers chosen by ns3
+            all_rx_nodes = [rx_node for rx_node in dict.fromkeys(channel_state_request.rx_nodes)
+                            if rx_node != tx_node and rx_node in self.node_info_dict]
+            if mand_rx_node not in all_rx_nodes:
+                all_rx_nodes.insert(0, mand_rx_node)
         else: # P2MP
             all_rx_nodes = list(self.node_info_dict.keys())
             all_rx_nodes.remove(tx_node)
 
         # number of channel calculations in look ahead
-        if self.mode == 3:
+        if self.mode == 3 and channel_state_request.look_ahead > 0:
+            # chosen by the look-ahead controller of ns3
+            look_ahead = channel_state_request.look_ahead
+        elif self.mode == 3:
             look_ahead = math.ceil(self.sub_mode / len(all_rx_nodes))
         else:
             look_ahead = 1
@@ -237,19 +274,334 @@ class SionnaEnv:
             print("Calc channel called:: %.6f: %d -> %d, #MP=%d, LAH=%d, Tc=%.2f ms"
                       % (simulation_time/1e9, tx_node, mand_rx_node, len(all_rx_nodes), look_ahead, self.chan_coh_time_mode23/1e6))
 
-        add_to_cache = dict()
-        for node_id in list(self.node_info_dict.keys()):
-            add_to_cache[node_id] = []
+        # the windows to be computed: (sim time, rx nodes)
+        # links still valid from a previous window are skipped in the look-ahead
+        windows = []
+        valid_until = dict()
+        for future_id in range(look_ahead):
+            future_simulation_time = int(simulation_time + future_id * self.chan_coh_time_mode23)
+            window_end = future_simulation_time + self.chan_coh_time_mode23
+            rx_nodes = [rx_node for rx_node in all_rx_nodes if valid_until.get(rx_node, -1) < window_end]
+            if len(rx_nodes) == 0:
+                continue
+            for rx_node in rx_nodes:
+                valid_until[rx_node] = self.get_link_end_time(tx_node, rx_node, future_simulation_time)
+            windows.append((future_simulation_time, rx_nodes))
+
+        # ZMQ response
+        chan_response = reply_wrapper.channel_state_response
+
+        if self.reply_first and self.mode != 1:
+            # drop look-ahead which is outdated or superseded by this request
+            self.drop_background_work(tx_node, simulation_time)
+
+            # deliver the look-ahead computed in the background since the last response
+            chan_response.csi.extend(self.pending_csi)
+            self.pending_csi.clear()
+
+            # the mandatory link is computed right away, everything else in the background
+            if not self.is_covered(chan_response, tx_node, mand_rx_node, simulation_time):
+                self.trace_windows_budgeted(tx_node, [(simulation_time, [mand_rx_node])], chan_response)
+
+            other_rx_nodes = [rx_node for rx_node in windows[0][1] if rx_node != mand_rx_node]
+            background_windows = [(simulation_time, other_rx_nodes)] + windows[1:]
+            self.queue_background_work(tx_node, background_windows)
+        else:
+            self.trace_windows_budgeted(tx_node, windows, chan_response)
+
+        if self.report_timing:
+            self.fill_timing(chan_response.timing, chan_response, time.perf_counter_ns() - request_start)
+
+        #if self.VERBOSE:
+        last_sim = simulation_time + (look_ahead - 1) * self.chan_coh_time_mode23
+        print("Calc channel finished:: LAH: Twin=%.6f -> %.6f" % (simulation_time/1e9, last_sim/1e9))
+
+
+    def warm_start(self, warm_start_request, reply_wrapper):
+        '''
+        Computes all links of the warm start request, i.e. one window per TX with all of its receivers
+        '''
+        request_start = time.perf_counter_ns()
+        self.timing.clear()
+        simulation_time = warm_start_request.time
+        chan_response = reply_wrapper.channel_state_response
+
+        num_links = 0
+        for tx_links in warm_start_request.links:
+            tx_node = tx_links.tx_node
+            rx_nodes = [rx_node for rx_node in dict.fromkeys(tx_links.rx_nodes)
+                        if rx_node != tx_node and rx_node in self.node_info_dict]
+            if tx_node not in self.node_info_dict or len(rx_nodes) == 0:
+                continue
+            self.rt_accuracy[tx_node] = warm_start_request.accuracy
+            self.trace_windows_budgeted(tx_node, [(simulation_time, rx_nodes)], chan_response)
+            num_links += len(rx_nodes)
+
+        if self.report_timing:
+            self.fill_timing(chan_response.timing, chan_response, time.perf_counter_ns() - request_start)
+
+        print("Warm start finished:: %d links of %d TX in %.2f sec"
+              % (num_links, len(warm_start_request.links), (time.perf_counter_ns() - request_start) / 1e9))
+
+
+    def fill_timing(self, timing, chan_response, total):
+        '''
+        Reports the time spent per phase for the current request
+        '''
+        timing.placement = self.timing["placement"]
+        timing.compute_paths = self.timing["compute_paths"]
+        timing.compute_paths_los = self.timing["compute_paths_los"]
+        timing.cir = self.timing["cir"]
+        timing.ofdm = self.timing["ofdm"]
+        timing.response = self.timing["response"]
+        timing.serialization = self.last_serialization_time
+        timing.background = self.background_time
+        timing.total = total
+        timing.num_links = self.timing["num_links"]
+        timing.num_windows = len(chan_response.csi)
+        self.background_time = 0
+
+
+    def is_covered(self, chan_response, tx_node, rx_node, simulation_time):
+        '''
+        Checks whether the response already contains a valid window for the given link
+        '''
+        for csi in chan_response.csi:
+            if csi.tx_node.id == tx_node and csi.start_time <= simulation_time:
+                for rx_node_info in csi.rx_nodes:
+                    end_time = rx_node_info.end_time if rx_node_info.end_time > 0 else csi.end_time
+                    if rx_node_info.id == rx_node and simulation_time <= end_time:
+                        return True
+        return False
+
+
+    def set_ttl_scale(self, tx_node, rx_node, ttl_scale):
+        key = (min(tx_node, rx_node), max(tx_node, rx_node))
+        if ttl_scale > 1:
+            self.ttl_scale[key] = ttl_scale
+        else:
+            self.ttl_scale.pop(key, None)
+
+
+    def get_ttl_scale(self, tx_node, rx_node):
+        return self.ttl_scale.get((min(tx_node, rx_node), max(tx_node, rx_node)), 1.0)
+
+
+    def get_link_end_time(self, tx_node, rx_node, simulation_time, ttl_scale=None):
+        '''
+        End of validity (in ns) of the channel of a link computed at the given time; derived from the coherence time
+        of the link and the remaining times until the nodes change their walk direction.
+        If both nodes do not move, the channel stays valid forever.
+        The coherence time is stretched by the adaptive TTL hint of the link (ttl_scale=1 for the unscaled validity)
+        but never beyond the next direction change.
+        '''
+        if ttl_scale is None:
+            ttl_scale = self.get_ttl_scale(tx_node, rx_node)
+
+        tx_node_position, tx_node_velocity = self.get_position_and_velocity(tx_node, simulation_time)
+        rx_node_position, rx_node_velocity = self.get_position_and_velocity(rx_node, simulation_time)
+
+        tx_delay_left = self.trajectories.get_delay_left(tx_node, simulation_time)
+        rx_delay_left = self.trajectories.get_delay_left(rx_node, simulation_time)
+
+        lnk_delay_left = min(tx_delay_left, rx_delay_left)
+        static = not np.any(tx_node_velocity) and not np.any(rx_node_velocity)
+        if static and lnk_delay_left >= RandomWalkTrajectories.INFINITE_DELAY:
+            return INFINITE_END_TIME
+
+        lnk_ttl = lnk_delay_left
+        lnk_v = np.linalg.norm(np.array(tx_node_velocity) - np.array(rx_node_velocity))
+
+        if lnk_v != 0:
+            # compute channel coherence time
+            lnk_ttl = min(ttl_scale * 9 * 299792458 * 1e9 / (16 * np.pi * lnk_v * self.scene.frequency.numpy()),
+                          lnk_delay_left)
+
+        return int(min(simulation_time + lnk_ttl, INFINITE_END_TIME))
+
+
+    def get_path_end_time(self, tx_node, rx_node, simulation_time):
+        '''
+        End of validity (in ns) of the paths of a link computed at the given time, i.e. the time until TX and RX
+        together moved the stationarity distance or the next direction change. Within, ns3 evolves the channel
+        from the Doppler shift of each path.
+        '''
+        _, tx_node_velocity = self.get_position_and_velocity(tx_node, simulation_time)
+        _, rx_node_velocity = self.get_position_and_velocity(rx_node, simulation_time)
+
+        lnk_delay_left = min(self.trajectories.get_delay_left(tx_node, simulation_time),
+                             self.trajectories.get_delay_left(rx_node, simulation_time))
+        lnk_speed = np.linalg.norm(tx_node_velocity) + np.linalg.norm(rx_node_velocity)
+        if lnk_speed == 0:
+            if lnk_delay_left >= RandomWalkTrajectories.INFINITE_DELAY:
+                return INFINITE_END_TIME
+            lnk_ttl = lnk_delay_left
+        else:
+            lnk_ttl = min(PATH_STATIONARITY_DISTANCE * 1e9 / lnk_speed, lnk_delay_left)
+
+        return int(min(simulation_time + lnk_ttl, INFINITE_END_TIME))
+
+
+    def get_path_angles(self, paths):
+        '''
+        Unit vectors of departure and arrival (pointing away from TX and RX) of all paths;
+        each with shape [..., num_rx, num_tx, max_num_paths, 3]
+        '''
+        def unit_vector(theta, phi):
+            theta = theta.numpy()
+            phi = phi.numpy()
+            return np.stack([np.sin(theta) * np.cos(phi), np.sin(theta) * np.sin(phi), np.cos(theta)], axis=-1)
+
+        return unit_vector(paths.theta_t, paths.phi_t), unit_vector(paths.theta_r, paths.phi_r)
+
+
+    def queue_background_work(self, tx_node, windows):
+        '''
+        Splits the given windows into small jobs computed in between the requests from ns3
+        '''
+        job = []
+        for future_simulation_time, rx_nodes in windows:
+            for i in range(0, len(rx_nodes), self.rt_max_parallel_links):
+                chunk = rx_nodes[i:i + self.rt_max_parallel_links]
+                if len(job) > 0 and len(job[0][1]) + len(chunk) > self.rt_max_parallel_links:
+                    self.background_jobs.append((tx_node, job))
+                    job = []
+                job.append((future_simulation_time, chunk))
+        if len(job) > 0:
+            self.background_jobs.append((tx_node, job))
+
+
+    def drop_background_work(self, tx_node, simulation_time):
+        '''
+        Removes queued jobs for the given TX as well as jobs which are outdated
+        '''
+        self.background_jobs = collections.deque(
+            (job_tx, windows) for job_tx, windows in self.background_jobs
+            if job_tx != tx_node and windows[-1][0] + self.chan_coh_time_mode23 >= simulation_time)
+
+
+    def has_background_work(self):
+        return len(self.background_jobs) > 0
+
+
+    def do_background_work(self):
+        '''
+        Computes the next queued look-ahead job; the result is delivered with the next response
+        '''
+        start = time.perf_counter_ns()
+        tx_node, windows = self.background_jobs.popleft()
+        tmp_response = message_pb2.ChannelStateResponse()
+        self.trace_windows_budgeted(tx_node, windows, tmp_response, collections.defaultdict(int))
+        self.pending_csi.extend(tmp_response.csi)
+        self.background_time += time.perf_counter_ns() - start
+
+        if self.VERBOSE:
+            print("Background channel computed:: %d -> %s, Twin=%.6f -> %.6f"
+                  % (tx_node, [rx for _, rx_nodes in windows for rx in rx_nodes], windows[0][0]/1e9, windows[-1][0]/1e9))
+
+
+    def get_object_boxes(self):
+        '''
+        Returns the axis-aligned bounding boxes of all scene objects as arrays (min, max)
+        '''
+        box_min = []
+        box_max = []
+        for obj in self.scene.objects.values():
+            bbox = obj.mi_shape.bbox()
+            box_min.append([float(bbox.min.x), float(bbox.min.y), float(bbox.min.z)])
+            box_max.append([float(bbox.max.x), float(bbox.max.y), float(bbox.max.z)])
+        return np.array(box_min).reshape(-1, 3), np.array(box_max).reshape(-1, 3)
+
+
+    def get_scene_density(self, position):
+        '''
+        Returns the no. of scene objects within RT_DENSITY_RADIUS of the given position
+        '''
+        box_min, box_max = self.object_boxes
+        p = np.array(position, dtype=float)
+        dist = np.linalg.norm(np.maximum(0, np.maximum(box_min - p, p - box_max)), axis=1)
+        return int(np.count_nonzero(dist <= RT_DENSITY_RADIUS))
+
+
+    def get_rt_budget(self, tx_node, rx_node, simulation_time, accuracy):
+        '''
+        Returns the ray tracing parameters (num_samples, max_depth, diffraction) of a link
+        '''
+        if accuracy not in RT_BUDGET:
+            return RT_NUM_SAMPLES, self.rt_max_depth, self.rt_calc_diffraction
+
+        tx_pos, _ = self.get_position_and_velocity(tx_node, simulation_time)
+        rx_pos, _ = self.get_position_and_velocity(rx_node, simulation_time)
+        distance = float(np.linalg.norm(np.array(tx_pos) - np.array(rx_pos)))
+        density = self.get_scene_density(tx_pos) + self.get_scene_density(rx_pos)
+        min_samples, max_samples, max_depth = RT_BUDGET[accuracy]
+
+        # same ray spacing at the RX, i.e. the no. of rays grows with the square of the distance;
+        # in half-decade steps, so that links share a ray tracing call
+        num_samples = max(min_samples * (distance / RT_BUDGET_REF_DISTANCE) ** 2, min_samples)
+        num_samples = int(min(10 ** (math.ceil(2 * math.log10(num_samples)) / 2), max_samples))
+
+        max_depth = min(max_depth, self.rt_max_depth)
+        if density == 0:
+            # open space: nothing but a possible ground to reflect from
+            max_depth = min(max_depth, 1)
+
+        # diffraction around corners matters for longer links in dense areas
+        diffraction = self.rt_calc_diffraction and (accuracy == message_pb2.ChannelStateRequest.ACCURACY_HIGH or
+                                                    (density >= RT_DENSE_OBJECTS and distance > RT_DIFFRACTION_DISTANCE))
+        return num_samples, max_depth, diffraction
+
+
+    def trace_windows_budgeted(self, tx_node, windows, chan_response, timing=None):
+        '''
+        Same as trace_windows, but the links are grouped by their ray tracing budget (see get_rt_budget)
+        and each group is traced in its own call
+        '''
+        accuracy = self.rt_accuracy.get(tx_node, message_pb2.ChannelStateRequest.ACCURACY_FIXED)
+        if accuracy not in RT_BUDGET:
+            self.trace_windows(tx_node, windows, chan_response, timing)
+            return
+
+        groups = collections.OrderedDict() # budget -> windows
+        for simulation_time, rx_nodes in windows:
+            for rx_node in rx_nodes:
+                group = groups.setdefault(self.get_rt_budget(tx_node, rx_node, simulation_time, accuracy), [])
+                if len(group) == 0 or group[-1][0] != simulation_time:
+                    group.append((simulation_time, []))
+                group[-1][1].append(rx_node)
+
+        for budget, group_windows in groups.items():
+            if self.VERBOSE:
+                print("Ray tracing budget:: num_samples=%d, max_depth=%d, diffraction=%r: %d links"
+                      % (budget[0], budget[1], budget[2], sum(len(rx_nodes) for _, rx_nodes in group_windows)))
+            self.trace_windows(tx_node, group_windows, chan_response, timing, budget)
+
+
+    def trace_windows(self, tx_node, windows, chan_response, timing=None, budget=None):
+        '''
+        Computes the channel from the TX to the given RX nodes for all windows in a single ray tracing call
+        and adds one ChannelState per window to the response. Each window is given by (sim time, rx nodes).
+        The time per phase is added to timing (in ns). The ray tracing budget is (num_samples, max_depth,
+        diffraction); by default the fixed budget of the server.
+        '''
+        if timing is None:
+            timing = self.timing
+        if budget is None:
+            budget = (RT_NUM_SAMPLES, self.rt_max_depth, self.rt_calc_diffraction)
+        num_samples, max_depth, diffraction = budget
+        phase_start = time.perf_counter_ns()
+
+        # Remove all last transmitter and receiver
+        for node_name in self.last_placed_nodes:
+            self.scene.remove(node_name)
+        self.last_placed_nodes.clear()
 
         tx_pos = {}
         tx_v = {}
         all_rx_pos = {}
         all_rx_v = {}
         # sim future node locations
-        for future_id in range(look_ahead):
-            future_simulation_time = int(simulation_time + future_id * self.chan_coh_time_mode23)
-            tx_pos[future_id] = []
-            tx_v[future_id] = []
+        for future_id, (future_simulation_time, rx_nodes) in enumerate(windows):
             all_rx_pos[future_id] = []
             all_rx_v[future_id] = []
 
@@ -257,8 +609,6 @@ class SionnaEnv:
             tx_node_position, tx_node_velocity = self.get_position_and_velocity(tx_node, future_simulation_time)
             tx_pos[future_id] = tx_node_position
             tx_v[future_id] = tx_node_velocity
-            ce = CacheEntry(future_simulation_time, self.chan_coh_time_mode23, (tx_node_position, tx_node_velocity))
-            add_to_cache[tx_node].append(ce)
 
             # Create the transmitter
             tx_node_name = "tx" + str(future_id)
@@ -270,7 +620,7 @@ class SionnaEnv:
             self.last_placed_nodes.append(tx_node_name)
 
             # place all nodes as RX
-            for rx_node in all_rx_nodes:
+            for rx_node in rx_nodes:
 
                 if self.VERBOSE:
                     print_csi_request(future_simulation_time, tx_node, rx_node)
@@ -280,9 +630,6 @@ class SionnaEnv:
                 all_rx_pos[future_id].append(rx_node_position)
                 all_rx_v[future_id].append(rx_node_velocity)
 
-                ce = CacheEntry(future_simulation_time, self.chan_coh_time_mode23, (rx_node_position, rx_node_velocity))
-                add_to_cache[rx_node].append(ce)
-
                 rx_node_name = "rx" + str(rx_node) + "." + str(future_id)
                 # Create the receiver
                 rx = Receiver(name=rx_node_name,
@@ -292,11 +639,7 @@ class SionnaEnv:
                 self.scene.add(rx)
                 self.last_placed_nodes.append(rx_node_name)
 
-        # update pos cache
-        for node_id in list(add_to_cache.keys()):
-            for tmp in add_to_cache[node_id]:
-                self.pos_velo_cache[node_id].append(tmp)
-
+        phase_start = add_phase_time(timing, "placement", phase_start)
 
         # WiFi parameters
         subcarrier_spacing = (self.scene.channel_bw / self.scene.fft_size)  # 312.5e3
@@ -304,30 +647,33 @@ class SionnaEnv:
 
         a, tau = 0, 0
         a_tau_set = False
+        k_t, k_r = None, None # path directions, only for the path response
 
         # Compute propagation paths
-        paths = self.scene.compute_paths(max_depth=self.rt_max_depth,
+        paths = self.scene.compute_paths(max_depth=max_depth,
                                     method="fibonacci",
-                                    num_samples=1e6,
+                                    num_samples=num_samples,
                                     los=True,
                                     reflection=True,
-                                    diffraction=self.rt_calc_diffraction,
+                                    diffraction=diffraction,
                                     scattering=False)
 
         has_paths = bool(paths.types.numpy().size)
         has_los_path = np.any(paths.types.numpy()[0] == 0)
+        phase_start = add_phase_time(timing, "compute_paths", phase_start)
 
         # If no LOS path was found, check again with different compute_paths parameters
         if not has_los_path:
             los_path = self.scene.compute_paths(max_depth=0,
                                            method="fibonacci",
-                                           num_samples=1e6,
+                                           num_samples=num_samples,
                                            los=True,
                                            reflection=False,
                                            diffraction=False,
                                            scattering=False)
 
             has_los_path = bool(los_path.types.numpy().size)
+            phase_start = add_phase_time(timing, "compute_paths_los", phase_start)
 
             if not has_paths and not has_los_path:
                 raise SystemExit(
@@ -339,6 +685,8 @@ class SionnaEnv:
                 # Compute the channel impulse response for LOS path
                 a, tau = los_path.cir()
                 a_tau_set = True
+                if self.path_response:
+                    k_t, k_r = self.get_path_angles(los_path)
 
         if has_paths:
             # Disable normalization of delays for paths
@@ -353,21 +701,39 @@ class SionnaEnv:
             else:
                 a, tau = a_paths, tau_paths
 
-        # Compute the frequencies of subcarriers and center around carrier frequency
-        frequencies = subcarrier_frequencies(num_subcarriers=fft_size,
-                                             subcarrier_spacing=subcarrier_spacing)
-
-        # Compute the frequency response of the channel at frequencies
-        h_freq = cir_to_ofdm_channel(frequencies=frequencies,
-                                     a=a,
-                                     tau=tau,
-                                     normalize=False)
-
-        # ZMQ response
-        chan_response = reply_wrapper.channel_state_response
-
-        for future_id in range(look_ahead):
-            future_simulation_time = int(simulation_time + future_id * self.chan_coh_time_mode23)
+            if self.path_response:
+                k_t_paths, k_r_paths = self.get_path_angles(paths)
+                if k_t is not None:
+                    k_t = np.concatenate([k_t, k_t_paths], axis=-2)
+                    k_r = np.concatenate([k_r, k_r_paths], axis=-2)
+                else:
+                    k_t, k_r = k_t_paths, k_r_paths
+        phase_start = add_phase_time(timing, "cir", phase_start)
+
+        if self.loss_delay_only or self.path_response:
+            # the frequency response is not needed; the loss follows from the path powers
+            h_freq = None
+            a = a.numpy()
+        else:
+            # Compute the frequencies of subcarriers and center around carrier frequency
+            frequencies = subcarrier_frequencies(num_subcarriers=fft_size,
+                                                 subcarrier_spacing=subcarrier_spacing)
+
+            # Compute the frequency response of the channel at frequencies
+            h_freq = cir_to_ofdm_channel(frequencies=frequencies,
+                                         a=a,
+                                         tau=tau,
+                                         normalize=False)
+
+            # convert once instead of per link
+            h_freq = h_freq.numpy()
+            band_h_freq = self.get_band_ofdm_channels(a, tau)
+            phase_start = add_phase_time(timing, "ofdm", phase_start)
+        tau = tau.numpy()
+
+        # index of the first rx node of each window into tensor
+        rx_offset = 0
+        for future_id, (future_simulation_time, rx_nodes) in enumerate(windows):
             # add new CSI
             csi = chan_response.csi.add()
 
@@ -379,44 +745,45 @@ class SionnaEnv:
             csi.tx_node.position.y = tx_pos[future_id][1]
             csi.tx_node.position.z = tx_pos[future_id][2]
 
-            for lnk_id, rx_node in enumerate(all_rx_nodes):
+            for lnk_id, rx_node in enumerate(rx_nodes):
                 # compute the index for the rx nodes into tensor
-                tf_index = future_id * len(all_rx_nodes) + lnk_id
+                tf_index = rx_offset + lnk_id
 
-                lnk_h_freq = h_freq.numpy()[:, tf_index, :, future_id, :, :, :]
-                lnk_tau = tau.numpy()[:, tf_index, future_id, :]
+                lnk_tau = tau[:, tf_index, future_id, :]
 
                 # Calculate propagation delay and propagation loss
                 lnk_delay = int(round(np.min(lnk_tau[lnk_tau >= 0] * 1e9), 0))
 
-                # see Parseval's theorem
-                lnk_loss = float(-10 * np.log10(tf.reduce_mean(tf.abs(lnk_h_freq) ** 2).numpy()))
-
-                # the channel frequency response (CFR)
-                lnk_csi = lnk_h_freq.flatten()
-
-                if self.mode == 1 and self.sub_mode > 0:
-                    # Calculate the time to live for the cache entry with the coherence time and the remaining times
-                    # until the nodes change their walk direction
-                    # If both nodes have the constant position model, the ttl is equal to one hour
-                    tx_delay_left = 3.6e12
-                    rx_delay_left = 3.6e12
-                    if self.node_info_dict[tx_node]["model"] == "Random Walk":
-                        tx_delay_left = self.node_info_dict[tx_node]["delay left"]
-                    if self.node_info_dict[rx_node]["model"] == "Random Walk":
-                        rx_delay_left = self.node_info_dict[rx_node]["delay left"]
-
-                    lnk_delay_left = min(tx_delay_left, rx_delay_left)
-
-                    lnk_ttl = int(lnk_delay_left)
-                    lnk_v = np.linalg.norm(np.array(tx_v[future_id]) - np.array(all_rx_v[future_id][lnk_id]))
-
-                    if lnk_v != 0:
-                        # compute channel coherence time
-                        lnk_ttl = int(
-                            min(9 * 299792458 * 1e9 / (16 * np.pi * lnk_v * self.scene.frequency.numpy()), lnk_delay_left))
-
-                    csi.end_time = int(future_simulation_time + lnk_ttl)
+                if h_freq is None:
+                    # sum of the path powers (invalid paths have zero amplitude), averaged over antennas and time
+                    lnk_a = a[:, tf_index, :, future_id, :, :, :]
+                    lnk_loss = float(-10 * np.log10(np.sum(np.abs(lnk_a) ** 2) / (lnk_a.size / lnk_a.shape[-2])))
+                    lnk_csi = None
+                else:
+                    lnk_h_freq = h_freq[:, tf_index, :, future_id, :, :, :]
+
+                    # see Parseval's theorem
+                    lnk_loss = float(-10 * np.log10(np.mean(np.abs(lnk_h_freq) ** 2)))
+
+                    # the channel frequency response (CFR)
+                    lnk_csi = lnk_h_freq.flatten()
+
+                # the validity of the link; in mode 2/3 the window end is the worst case over all links
+                lnk_end_time = csi.end_time
+                lnk_base_end_time = 0
+                ttl_scale = self.get_ttl_scale(tx_node, rx_node)
+                if self.mode != 1 or self.sub_mode > 0:
+                    lnk_end_time = self.get_link_end_time(tx_node, rx_node, future_simulation_time, ttl_scale)
+                    if ttl_scale > 1:
+                        lnk_base_end_time = self.get_link_end_time(tx_node, rx_node, future_simulation_time, 1.0)
+                elif ttl_scale > 1:
+                    lnk_base_end_time = lnk_end_time
+                    lnk_end_time = int(future_simulation_time + ttl_scale * self.chan_coh_time_mode23)
+                if self.path_response:
+                    lnk_end_time = self.get_path_end_time(tx_node, rx_node, future_simulation_time)
+                    lnk_base_end_time = 0
+                if self.mode == 1:
+                    csi.end_time = lnk_end_time
 
                 #if self.VERBOSE:
                 #    self.print_csi_response(simulation_time, tx_node, rx_node, tx_node_position, all_rx_pos[future_id][lnk_id], lnk_delay, lnk_loss, lnk_ttl)
@@ -428,183 +795,134 @@ class SionnaEnv:
                 rx_node_info.position.z = all_rx_pos[future_id][lnk_id][2]
                 rx_node_info.delay = lnk_delay
                 rx_node_info.wb_loss = lnk_loss
-
-                if self.est_csi:
+                rx_node_info.end_time = lnk_end_time
+                if 0 < lnk_base_end_time < lnk_end_time:
+                    rx_node_info.base_end_time = lnk_base_end_time
+                rx_node_info.rt_num_samples = num_samples
+                rx_node_info.rt_max_depth = max_depth
+                rx_node_info.rt_diffraction = diffraction
+
+                if self.est_csi and lnk_csi is not None:
                     rx_node_info.csi_imag.extend(list(np.imag(lnk_csi)))
                     rx_node_info.csi_real.extend(list(np.real(lnk_csi)))
 
-        #if self.VERBOSE:
-        last_sim = simulation_time + (look_ahead - 1) * self.chan_coh_time_mode23
-        print("Calc channel finished:: LAH: Twin=%.6f -> %.6f" % (simulation_time/1e9, last_sim/1e9))
-
-
-    def get_value(self, random_variable):
-        if random_variable[0] == "Uniform":
-            return np.random.uniform(random_variable[1], random_variable[2])
-
-        elif random_variable[0] == "Constant":
-            return random_variable[1]
-
-        elif random_variable[0] == "Normal":
-            return np.random.normal(random_variable[1], np.sqrt(random_variable[2]))
-
-
-    def walk(self, node_id, delay_left):
-
-        self.node_info_dict[node_id]["last update"] += delay_left
-
-        position = np.array(self.node_info_dict[node_id]["position"])
-        velocity = np.array(self.node_info_dict[node_id]["velocity"])
-
-        speed = np.linalg.norm(velocity)
-        if speed == 0:
-            return
-
-        # Check if the next position is inside the borders
-        # Calculate direction vector and travel distance
-        direction = velocity / speed
-        distance = np.linalg.norm(velocity * delay_left / 1e9)
-
-        # Set mitsuba variant to SCALAR for mobility model
-        mi.set_variant('scalar_rgb')
-
-        while True:
-            # Create a ray
-            ray = mi.Ray3f(mi.Point3f(position), mi.Vector3f(direction), distance, 0.0, [])
-
-            # Calculate the intersection of the ray with the scene
-            ray_flags = mi.RayFlags.Minimal
-            coherent = False
-            active = True
-            si = self.mi_scene.ray_intersect(ray, ray_flags, coherent, active)
-
-            if si.is_valid():
-                # If the ray hits an object, calculate the reflection
-
-                # The intersection point (position) is set back by one centimeter to prevent cases
-                # where the intersection point is found behind a wall
-                t = si.t - 0.01
-                position = position + t * direction
-
-                # The reflected direction is calculated in the z plane
-                n = np.array(si.n)
-                n = [n[1], -n[0], 0.0]
-                n = n / np.linalg.norm(n)
-                direction = - (direction - 2 * np.dot(direction, n) * n)
-
-                velocity = direction * speed
-                distance -= t
-                delay_left -= (t / speed) * 1e9
-
-                # For testing
-                # print(f"CourseChange x = {position[0]}, y = {position[1]}, z = {position[2]}")
-
-            else:
-                # If the ray does not hit an object, calculate the next position
-                break
-
-        next_position = position + (velocity * delay_left / 1e9)
-
-        self.node_info_dict[node_id]["velocity"] = velocity.tolist()
-        self.node_info_dict[node_id]["position"] = next_position.tolist()
-
-        # Set the mitsuba variant back to how Sionna configures it
-        if len(gpus) > 0:
-            mi.set_variant('cuda_ad_rgb')
-        else:
-            mi.set_variant('llvm_ad_rgb')
-
-
-    def remove_all_cached_entries(self, simulation_time):
-        for k in list(self.pos_velo_cache.keys()):
-            tmp = self.pos_velo_cache[k][:]
-            for l in tmp:
-                if l.sim_time + l.ttl < simulation_time - self.max_pos_cache_age: # keep last ...
-                    self.pos_velo_cache[k].remove(l)
-
-
-    def get_position_and_velocity(self, node_id, simulation_time):
-        # search in cache for pos/velocity
-        best_match_value = None
-        best_metric = 1e12
-        for item in self.pos_velo_cache[node_id]:
-            middle = item.sim_time + item.ttl / 2.0
-            metric = abs(middle - simulation_time)
-            if metric < best_metric and metric <= self.chan_coh_time_mode23:
-                best_match_value = item.value
-                best_metric = abs(middle - simulation_time)
-
-        if best_match_value is not None:
-            # print("Old pos lookupd for node %d at %d: %s" % (node_id, simulation_time, best_match_value[0]))
-            return best_match_value
-
-        # sim mobility w/ ray tracing
-        value = self.compute_position_and_velocity(node_id, simulation_time)
-        # print("New pos computed for node %d at %d: %s" % (node_id, simulation_time, value[0]))
-
-        return value
-
-
-    def compute_position_and_velocity(self, node_id, simulation_time):
+                if h_freq is not None:
+                    for h_band in band_h_freq:
+                        lnk_h_band = h_band[:, tf_index, :, future_id, :, :, :]
+                        band_state = rx_node_info.bands.add()
+                        band_state.wb_loss = float(-10 * np.log10(np.mean(np.abs(lnk_h_band) ** 2)))
+                        if self.est_csi:
+                            band_state.csi_real.extend(np.real(lnk_h_band).flatten().tolist())
+                            band_state.csi_imag.extend(np.imag(lnk_h_band).flatten().tolist())
+
+                if self.path_response:
+                    # SISO: gains of the first time step; invalid paths have a negative delay
+                    lnk_a = a[0, tf_index, 0, future_id, 0, :, 0]
+                    lnk_tau = tau[0, tf_index, future_id, :]
+                    valid = (lnk_tau >= 0) & (np.abs(lnk_a) > 0)
+                    # Doppler shift from the velocities projected onto the directions of departure and arrival
+                    wavelength = 299792458 / self.scene.frequency.numpy()
+                    lnk_k_t = k_t[..., tf_index, future_id, :, :].reshape(-1, 3)
+                    lnk_k_r = k_r[..., tf_index, future_id, :, :].reshape(-1, 3)
+                    lnk_doppler = (lnk_k_t @ np.array(tx_v[future_id], dtype=float)
+                                   + lnk_k_r @ np.array(all_rx_v[future_id][lnk_id], dtype=float)) / wavelength
+                    rx_node_info.path_gain_real.extend(np.real(lnk_a[valid]).tolist())
+                    rx_node_info.path_gain_imag.extend(np.imag(lnk_a[valid]).tolist())
+                    rx_node_info.path_delay.extend(lnk_tau[valid].tolist())
+                    rx_node_info.path_doppler.extend(lnk_doppler[valid].tolist())
+
+            rx_offset += len(rx_nodes)
+
+        timing["num_links"] += rx_offset
+        add_phase_time(timing, "response", phase_start)
+
+
+    def get_band_ofdm_channels(self, a, tau):
         '''
-        Mobility simulation to compute the next position and velocity
+        Computes the OFDM channel of the paths for each further band. The paths are traced at the frequency of
+        the scene; for another carrier the gain of each path scales with the wavelength as in free space and its
+        phase rotates by its delay, whereas the material properties of the scene frequency are kept.
         '''
+        if not self.bands:
+            return []
+        f_0 = float(self.scene.frequency.numpy())
+        a_np = a.numpy()
+        tau_np = tau.numpy()
+        # a: [batch, rx, rx_ant, tx, tx_ant, path, time], tau: [batch, rx, tx, path]
+        tau_a = tau_np[:, :, np.newaxis, :, np.newaxis, :, np.newaxis]
+        band_h_freq = []
+        for frequency, channel_bw, fft_size in self.bands:
+            a_band = a_np * (f_0 / frequency) * np.exp(-2j * np.pi * (frequency - f_0) * tau_a)
+            frequencies = subcarrier_frequencies(num_subcarriers=fft_size,
+                                                 subcarrier_spacing=channel_bw / fft_size)
+            h_band = cir_to_ofdm_channel(frequencies=frequencies,
+                                         a=tf.constant(a_band.astype(a_np.dtype)),
+                                         tau=tau,
+                                         normalize=False)
+            band_h_freq.append(h_band.numpy())
+        return band_h_freq
 
-        # If node position is constant, return current position
-        if self.node_info_dict[node_id]["model"] == "Constant Position":
-            return self.node_info_dict[node_id]["position"], [0.0, 0.0, 0.0]
-
-        # If simulation_time is less than last_update, print a warning and return the last position and velocity
-        if simulation_time < self.node_info_dict[node_id]["last update"]:
-            warnings.warn(
-                f"Trying to calculate the current position and velocity for node {node_id} at time {simulation_time} ns. "
-                f"The position and velocity for node {node_id} has already been calculated at time {self.node_info_dict[node_id]['last update']} ns.",
-                UserWarning)
-
-            print("Sim time: %d" % simulation_time)
-            for item in self.pos_velo_cache[node_id]:
-                print(item.sim_time)
-            print("====")
-
-            return self.node_info_dict[node_id]["position"], self.node_info_dict[node_id]["velocity"]
-
-        delay_left = self.node_info_dict[node_id]["delay left"]
-
-        # If delay_left equals 0, calculate new walk direction
-        if delay_left == 0:
-            # Choose speed and direction
-            speed = self.get_value(self.node_info_dict[node_id]["speed"])
-            direction = round(self.get_value(self.node_info_dict[node_id]["direction"]), 3)
 
-            # Calculate new velocity
-            velocity = [np.cos(direction) * speed, np.sin(direction) * speed, 0.0]
-            self.node_info_dict[node_id]["velocity"] = velocity
-
-            # Calculate the remaining time to walk in the new direction
-            if self.node_info_dict[node_id]["mode"][0] == "Time":
-                delay_left = self.node_info_dict[node_id]["mode"][1]
-            elif self.node_info_dict[node_id]["mode"][0] == "Distance":
-                # If speed is 0, a random walk model with mode "Distance" becomes a constant position model
-                if speed == 0:
-                    self.node_info_dict[node_id]["model"] = "Constant Position"
-                    return self.node_info_dict[node_id]["position"], [0.0, 0.0, 0.0]
+    def get_position_and_velocity(self, node_id, simulation_time):
+        """
+        Looks up the position and velocity of a node in the precomputed trajectories
+        """
+        return self.trajectories.get_position_and_velocity(node_id, simulation_time)
 
-                delay_left = abs(self.node_info_dict[node_id]["mode"][1] / speed) * 1e9
 
-            if self.VERBOSE:
-                pos = self.node_info_dict[node_id]["position"]
-                print(f"CourseChange x = {pos[0]}, y = {pos[1]}, z = {pos[2]}")
-
-        # Walk until the current simulation time is reached
-        if self.node_info_dict[node_id]["last update"] + delay_left < simulation_time:
-            self.walk(node_id, delay_left)
-            self.node_info_dict[node_id]["delay left"] = 0
-            return self.compute_position_and_velocity(node_id, simulation_time)
-        else:
-            self.node_info_dict[node_id]["delay left"] = self.node_info_dict[node_id][
-                                                        "last update"] + delay_left - simulation_time
-            self.walk(node_id, simulation_time - self.node_info_dict[node_id]["last update"])
-            return self.node_info_dict[node_id]["position"], self.node_info_dict[node_id]["velocity"]
+    def handle_message(self, from_ns3_message):
+        """
+        Handles a single serialized message from ns3 and returns the serialized reply
+        """
+        # Deserialize the message
+        from_ns3_wrapper = message_pb2.Wrapper()
+        from_ns3_wrapper.ParseFromString(from_ns3_message)
+
+        # Prepare the reply message
+        to_ns3_wrapper = message_pb2.Wrapper()
+
+        # Fill the reply message
+        if from_ns3_wrapper.HasField("sim_init_msg"):
+            # handle SimInitMessage & send ACK
+            self.store_simulation_info(from_ns3_wrapper.sim_init_msg)
+            to_ns3_wrapper.sim_ack.SetInParent()
+            to_ns3_wrapper.sim_ack.scene_load_time = self.scene_load_time
+            to_ns3_wrapper.sim_ack.scene_cached = self.scene_cached
+            to_ns3_wrapper.sim_ack.loss_delay_only = self.loss_delay_only
+            to_ns3_wrapper.sim_ack.path_response = self.path_response
+            to_ns3_wrapper.sim_ack.client_mobility = self.client_mobility
+            to_ns3_wrapper.sim_ack.num_bands = 1 + len(self.bands)
+            print("Sionna server socket connected ...")
+
+        elif from_ns3_wrapper.HasField("channel_state_request"):
+            # handle ChannelStateRequest by sending ChannelStateResponse
+            start_time = time.time()
+            self.calculate_channel_state(from_ns3_wrapper.channel_state_request, to_ns3_wrapper)
+            call_time = time.time() - start_time
+            self.last_call_times.append(call_time)
+            self.num_processed_csi_req += 1
+
+            if self.VERBOSE or self.num_processed_csi_req % 1 == 0:
+                print("t=%.9fs: average event processing time: %.2f sec"
+                      % (from_ns3_wrapper.channel_state_request.time/1e9, np.nanmean(self.last_call_times)))
+
+        elif from_ns3_wrapper.HasField("warm_start_request"):
+            # handle WarmStartRequest by sending ChannelStateResponse
+            self.warm_start(from_ns3_wrapper.warm_start_request, to_ns3_wrapper)
+
+        elif from_ns3_wrapper.HasField("sim_close_request"):
+            self.socket_open = False
+            to_ns3_wrapper.sim_ack.SetInParent()
+
+        # Serialize the reply message
+        start = time.perf_counter_ns()
+        to_ns3_message = to_ns3_wrapper.SerializeToString()
+        self.last_serialization_time = time.perf_counter_ns() - start
+        return to_ns3_message
+
+
+    def print_summary(self):
+        print("Mode: %d , submode: %d , NoCSI: %d , avgevent: %.2f" % (self.mode, self.sub_mode, self.num_processed_csi_req, np.nanmean(self.last_call_times)))
 
 
     def run(self):
@@ -615,50 +933,23 @@ class SionnaEnv:
         context = zmq.Context()
         socket = zmq.Socket(context, zmq.REP)
         socket.bind("tcp://*:5555")
-        socket_open = True
+        self.socket_open = True
         print("Sionna server socket ready ...")
 
-        last_call_times = []
-        num_processed_csi_req = 0
-        while socket_open:
+        while self.socket_open:
+            # Use the idle time between requests for the look-ahead
+            if self.has_background_work() and not socket.poll(0):
+                self.do_background_work()
+                continue
+
             # Receive message from ns3
             from_ns3_message = socket.recv()
 
-            # Deserialize the message
-            from_ns3_wrapper = message_pb2.Wrapper()
-            from_ns3_wrapper.ParseFromString(from_ns3_message)
-
-            # Prepare the reply message
-            to_ns3_wrapper = message_pb2.Wrapper()
-
-            # Fill the reply message
-            if from_ns3_wrapper.HasField("sim_init_msg"):
-                # handle SimInitMessage & send ACK
-                self.store_simulation_info(from_ns3_wrapper.sim_init_msg)
-                to_ns3_wrapper.sim_ack.SetInParent()
-                print("Sionna server socket connected ...")
-
-            elif from_ns3_wrapper.HasField("channel_state_request"):
-                # handle ChannelStateRequest by sending ChannelStateResponse
-                start_time = time.time()
-                self.calculate_channel_state(from_ns3_wrapper.channel_state_request, to_ns3_wrapper)
-                call_time = time.time() - start_time
-                last_call_times.append(call_time)
-                num_processed_csi_req += 1
-
-                if self.VERBOSE or num_processed_csi_req % 1 == 0:
-                    print("t=%.9fs: average event processing time: %.2f sec"
-                          % (from_ns3_wrapper.channel_state_request.time/1e9, np.nanmean(last_call_times)))
-
-            elif from_ns3_wrapper.HasField("sim_close_request"):
-                socket_open = False
-                to_ns3_wrapper.sim_ack.SetInParent()
-
-            # Serialize and send the reply message
-            socket.send(to_ns3_wrapper.SerializeToString())
+            # Send the reply message
+            socket.send(self.handle_message(from_ns3_message))
 
         socket.close()
-        print("Mode: %d , submode: %d , NoCSI: %d , avgevent: %.2f" % (self.mode, self.sub_mode, num_processed_csi_req, np.nanmean(last_call_times)))
+        self.print_summary()
         print("Sionna server socket closed.")
         # cleanup sionna
 
@@ -670,15 +961,31 @@ if __name__ == '__main__':
     parser.add_argument("--rt_max_depth", type=int, default=6, help="Calc diffraction in raytracing")
     parser.add_argument("--rt_max_parallel_links", type=int, default=4, help="Max no. of receivers")
     parser.add_argument("--est_csi", help="Whether to estimate complex CSI per OFDM subcarrier", action='store_true')
+    parser.add_argument("--mobility_horizon", type=float, default=10.0, help="Time horizon (in s) of precomputed random walk trajectories (not used with client mobility)")
+    parser.add_argument("--num_workers", type=int, default=1, help="No. of worker processes computing channels in parallel")
+    parser.add_argument("--scene_pool_size", type=int, default=1, help="Keep the loaded scene across jobs (0: load it for every job; Sionna holds a single scene)")
     parser.add_argument("--verbose", help="Whether to run in verbose mode", action='store_true')
     args = parser.parse_args()
 
     print("ns3sionna v0.2")
-    while True:
-        print("Using config: rt_calc_diffraction=%s, rt_max_depth=%s, rt_max_parallel_links=%d, est_csi=%r" % (args.rt_calc_diffraction, args.rt_max_depth, args.rt_max_parallel_links, args.est_csi))
-        print("Waiting for new job ...")
-        env = SionnaEnv(args.rt_calc_diffraction, args.rt_max_depth, args.rt_max_parallel_links, args.est_csi, VERBOSE=args.verbose)
-        env.run()
-
-        if args.single_run:
-            break
+    env_args = dict(rt_calc_diffraction=args.rt_calc_diffraction, rt_max_depth=args.rt_max_depth,
+                    rt_max_parallel_links=args.rt_max_parallel_links, est_csi=args.est_csi,
+                    mobility_horizon=args.mobility_horizon, VERBOSE=args.verbose)
+
+    if args.num_workers > 1:
+        # pool of worker processes behind a single endpoint; the pool serves all jobs
+        print("Using config: %s, num_workers=%d" % (env_args, args.num_workers))
+        pool = SionnaWorkerPool(args.num_workers, env_args, scene_pool_size=args.scene_pool_size)
+        pool.run(args.single_run)
+    else:
+        # scenes are kept across jobs
+        scene_pool = ScenePool(args.scene_pool_size)
+        while True:
+            print("Using config: rt_calc_diffraction=%s, rt_max_depth=%s, rt_max_parallel_links=%d, est_csi=%r, mobility_horizon=%.1f"
+                  % (args.rt_calc_diffraction, args.rt_max_depth, args.rt_max_parallel_links, args.est_csi, args.mobility_horizon))
+            print("Waiting for new job ...")
+            env = SionnaEnv(**env_args, scene_pool=scene_pool)
+            env.run()
+
+            if args.single_run:
+                break
@@ -0,0 +1,223 @@
+import collections
+import multiprocessing
+import os
+
+import zmq
+import message_pb2
+
+# control messages between the front end and the workers
+WORKER_READY = b"READY"
+WORKER_SHUTDOWN = b"SHUTDOWN"
+
+
+def run_worker(worker_id, backend_url, env_args, num_threads, scene_pool_size):
+    """
+    Worker process: owns its own Sionna environment and serves the requests forwarded by the front end.
+    A new environment is created for each job, i.e. with each SimInitMessage, while loaded scenes are kept.
+    """
+    # imported here as each worker is a freshly spawned process with its own TF/Mitsuba state
+    import drjit as dr
+    import tensorflow as tf
+    from scene_pool import ScenePool
+    from sionna_server import SionnaEnv
+
+    # share the cores of the machine between the workers
+    dr.set_thread_count(num_threads)
+    try:
+        tf.config.threading.set_intra_op_parallelism_threads(num_threads)
+        tf.config.threading.set_inter_op_parallelism_threads(num_threads)
+    except RuntimeError as e:
+        print(e)
+
+    context = zmq.Context()
+    socket = context.socket(zmq.DEALER)
+    socket.setsockopt(zmq.IDENTITY, worker_id)
+    socket.connect(backend_url)
+    socket.send(WORKER_READY)
+
+    scene_pool = ScenePool(scene_pool_size)
+    env = None
+    while True:
+        # Use the idle time between requests for the look-ahead
+        if env is not None and env.has_background_work() and not socket.poll(0):
+            env.do_background_work()
+            continue
+
+        frames = socket.recv_multipart()
+        envelope, from_ns3_message = frames[:-1], frames[-1]
+
+        if from_ns3_message == WORKER_SHUTDOWN:
+            break
+
+        if env is None:
+            env = SionnaEnv(**env_args, scene_pool=scene_pool)
+
+        socket.send_multipart(envelope + [env.handle_message(from_ns3_message)])
+
+        if not env.socket_open:
+            # job finished
+            print("Worker %s: " % worker_id.decode(), end="")
+            env.print_summary()
+            env = None
+
+    socket.close()
+    context.term()
+
+
+class SionnaWorkerPool:
+    """
+    Pool of worker processes behind a single ZMQ endpoint.
+
+    The front end is a ROUTER socket accepting the same messages as the single-threaded REP server.
+    Channel state requests are assigned to workers by transmitter, so that all requests of a TX node
+    are served by the same worker and its look-ahead state stays consistent. Mobility does not depend
+    on the assignment: each worker walks the nodes on its own, but the trajectory of a node only depends
+    on the seed, the node ID and the scene (see RandomWalkTrajectories), hence a node has the same
+    position in every worker, e.g. as TX in one worker and as RX in another, and links are reciprocal
+    for any number of workers and any request timing. SimInitMessage
+    and SimCloseRequest are sent to all workers, so that each worker has the scene already loaded;
+    the ack is returned once all workers answered. Several requests in flight (from batched or async
+    clients) are computed in parallel.
+    """
+
+    def __init__(self, num_workers, env_args, frontend_url="tcp://*:5555", num_threads=None, scene_pool_size=1):
+        self.num_workers = num_workers
+        self.env_args = env_args
+        self.scene_pool_size = scene_pool_size
+        self.frontend_url = frontend_url
+        if num_threads is None:
+            num_threads = max(1, (os.cpu_count() or 1) // num_workers)
+        self.num_threads = num_threads
+        self.worker_ids = [("worker-%d" % i).encode() for i in range(num_workers)]
+
+
+    def get_worker(self, from_ns3_wrapper):
+        '''
+        Returns the workers the message needs to be sent to
+        '''
+        if from_ns3_wrapper.HasField("channel_state_request"):
+            tx_node = from_ns3_wrapper.channel_state_request.tx_node
+            return [self.worker_ids[tx_node % self.num_workers]]
+        # SimInitMessage, SimCloseRequest
+        return self.worker_ids
+
+
+    def split_warm_start(self, from_ns3_wrapper):
+        '''
+        Splits a WarmStartRequest by TX like the channel state requests; returns (worker id, message) per worker
+        '''
+        warm_start_request = from_ns3_wrapper.warm_start_request
+        parts = collections.OrderedDict() # worker id -> wrapper
+        for tx_links in warm_start_request.links:
+            worker_id = self.worker_ids[tx_links.tx_node % self.num_workers]
+            if worker_id not in parts:
+                parts[worker_id] = message_pb2.Wrapper()
+                parts[worker_id].warm_start_request.time = warm_start_request.time
+                parts[worker_id].warm_start_request.accuracy = warm_start_request.accuracy
+            parts[worker_id].warm_start_request.links.append(tx_links)
+        if not parts:
+            # nothing to compute: still answered by a worker
+            parts[self.worker_ids[0]] = from_ns3_wrapper
+        return [(worker_id, wrapper.SerializeToString()) for worker_id, wrapper in parts.items()]
+
+
+    def run(self, single_run):
+        """
+        Forwards messages between ns3 and the workers until the end of the (last) job
+        """
+        context = zmq.Context()
+        frontend = context.socket(zmq.ROUTER)
+        frontend.bind(self.frontend_url)
+        backend = context.socket(zmq.ROUTER)
+        backend_port = backend.bind_to_random_port("tcp://127.0.0.1")
+        backend_url = "tcp://127.0.0.1:%d" % backend_port
+
+        # spawn instead of fork as TF/Mitsuba are not fork-safe
+        mp_context = multiprocessing.get_context("spawn")
+        workers = [mp_context.Process(target=run_worker, args=(worker_id, backend_url, self.env_args, self.num_threads,
+                                                                      self.scene_pool_size),
+                                      daemon=True)
+                   for worker_id in self.worker_ids]
+        for worker in workers:
+            worker.start()
+
+        # messages to a not yet connected worker would be dropped by the ROUTER socket
+        ready = set()
+        while len(ready) < self.num_workers:
+            worker_id, msg = backend.recv_multipart()
+            if msg == WORKER_READY:
+                ready.add(worker_id)
+        print("Sionna server socket ready with %d workers ..." % self.num_workers)
+
+        poller = zmq.Poller()
+        poller.register(frontend, zmq.POLLIN)
+        poller.register(backend, zmq.POLLIN)
+
+        # messages sent to all workers: envelope -> [no. of missing replies, is close request]
+        pending_broadcasts = dict()
+        # warm start split among the workers: envelope -> [no. of missing replies, merged reply]
+        pending_merges = dict()
+        running = True
+        while running:
+            events = dict(poller.poll())
+
+            if events.get(frontend) == zmq.POLLIN:
+                # [client id, empty delimiter, message]
+                frames = frontend.recv_multipart()
+                envelope, from_ns3_message = frames[:-1], frames[-1]
+
+                from_ns3_wrapper = message_pb2.Wrapper()
+                from_ns3_wrapper.ParseFromString(from_ns3_message)
+
+                if from_ns3_wrapper.HasField("warm_start_request"):
+                    parts = self.split_warm_start(from_ns3_wrapper)
+                    pending_merges[tuple(envelope)] = [len(parts), message_pb2.Wrapper()]
+                    for worker_id, part in parts:
+                        backend.send_multipart([worker_id] + envelope + [part])
+                    continue
+
+                targets = self.get_worker(from_ns3_wrapper)
+                if len(targets) > 1:
+                    pending_broadcasts[tuple(envelope)] = [len(targets), from_ns3_wrapper.HasField("sim_close_request")]
+
+                for worker_id in targets:
+                    backend.send_multipart([worker_id] + envelope + [from_ns3_message])
+
+            if events.get(backend) == zmq.POLLIN:
+                frames = backend.recv_multipart()
+                envelope, to_ns3_message = frames[1:-1], frames[-1]
+
+                key = tuple(envelope)
+                if key in pending_merges:
+                    # the windows of all workers in a single response; timing as reported by the last worker
+                    merge = pending_merges[key]
+                    reply_wrapper = message_pb2.Wrapper()
+                    reply_wrapper.ParseFromString(to_ns3_message)
+                    merge[1].channel_state_response.csi.extend(reply_wrapper.channel_state_response.csi)
+                    if reply_wrapper.channel_state_response.HasField("timing"):
+                        merge[1].channel_state_response.timing.CopyFrom(reply_wrapper.channel_state_response.timing)
+                    merge[0] -= 1
+                    if merge[0] > 0:
+                        continue
+                    pending_merges.pop(key)
+                    to_ns3_message = merge[1].SerializeToString()
+                elif key in pending_broadcasts:
+                    pending_broadcasts[key][0] -= 1
+                    if pending_broadcasts[key][0] > 0:
+                        continue
+                    _, is_close = pending_broadcasts.pop(key)
+                    if is_close:
+                        print("Sionna server job finished.")
+                        running = not single_run
+
+                frontend.send_multipart(envelope + [to_ns3_message])
+
+        for worker_id in self.worker_ids:
+            backend.send_multipart([worker_id, WORKER_SHUTDOWN])
+        for worker in workers:
+            worker.join()
+
+        frontend.close()
+        backend.close()
+        context.term()
+        print("Sionna server socket closed.")